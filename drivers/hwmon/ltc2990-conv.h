@@ -0,0 +1,170 @@
+/*
+ * LTC2990 register map and measurement conversion
+ *
+ * Copyright (C) 2014 Topic Embedded Products
+ *
+ * License: GPLv2
+ *
+ * Shared by the driver and the userspace tools, so both convert raw
+ * register contents in exactly the same way.
+ */
+
+#ifndef _LTC2990_CONV_H
+#define _LTC2990_CONV_H
+
+#ifdef __KERNEL__
+#include <linux/bitops.h>
+#include <linux/types.h>
+#else
+#include <stdint.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef int32_t s32;
+typedef uint32_t u32;
+
+#define BIT(nr)			(1UL << (nr))
+
+static inline s32 sign_extend32(u32 value, int index)
+{
+	u8 shift = 31 - index;
+
+	return (s32)(value << shift) >> shift;
+}
+#endif
+
+#define LTC2990_STATUS	0x00
+#define LTC2990_CONTROL	0x01
+#define LTC2990_TRIGGER	0x02
+#define LTC2990_TINT_MSB	0x04
+#define LTC2990_V1_MSB	0x06
+#define LTC2990_V2_MSB	0x08
+#define LTC2990_V3_MSB	0x0A
+#define LTC2990_V4_MSB	0x0C
+#define LTC2990_VCC_MSB	0x0E
+
+#define LTC2990_CONTROL_KELVIN		BIT(7)
+#define LTC2990_CONTROL_SINGLE		BIT(6)
+#define LTC2990_CONTROL_MEASURE_ALL	(0x3 << 3)
+#define LTC2990_CONTROL_MODE_CURRENT	0x06
+#define LTC2990_CONTROL_MODE_VOLTAGE	0x07
+#define LTC2990_CONTROL_MODE_MASK	0x07
+#define LTC2990_NUM_MODES		8
+
+/* Set in every measurement register once it holds a fresh conversion */
+#define LTC2990_DATA_VALID		BIT(15)
+
+/* Index of a measurement register in the raw register arrays */
+#define LTC2990_REG_IDX(reg)	(((reg) - LTC2990_TINT_MSB) >> 1)
+#define LTC2990_NUM_REGS	(LTC2990_REG_IDX(LTC2990_VCC_MSB) + 1)
+
+/*
+ * Conversion of the raw register contents: mask the data bits, sign
+ * extend from bit 'sign', then scale by num/den and add offset.
+ */
+/* temperature, 0.0625 degrees/LSB, 13-bit, result in mC */
+#define LTC2990_CONV_TEMP	.mask = 0x1FFF, .sign = 12,		\
+				.num = 1000, .den = 16, .offset = 0
+/* Vx-Vy, 19.42uV/LSB, result in uV (mA across 1mOhm) */
+#define LTC2990_CONV_DIFF	.mask = 0x7FFF, .sign = 14,		\
+				.num = 1942, .den = 100, .offset = 0
+/* Vx, 305.18uV/LSB, result in mV */
+#define LTC2990_CONV_SINGLE	.mask = 0x7FFF, .sign = 14,		\
+				.num = 30518, .den = 100000, .offset = 0
+/* Vcc, 305.18uV/LSB, 2.5V offset, result in mV */
+#define LTC2990_CONV_VCC	.mask = 0x7FFF, .sign = 14,		\
+				.num = 30518, .den = 100000, .offset = 2500
+
+/*
+ * Every input the chip can report in any mode: id, attribute prefix, IIO
+ * channel index, register and conversion. The channel enum, conversion
+ * table, sysfs attributes and IIO channels are all generated from this.
+ */
+#define LTC2990_CHANNELS(X)					\
+	X(TEMP1, temp1, 0, LTC2990_TINT_MSB, TEMP)		\
+	X(TEMP2, temp2, 1, LTC2990_V1_MSB, TEMP)		\
+	X(TEMP3, temp3, 2, LTC2990_V3_MSB, TEMP)		\
+	X(CURR1, curr1, 0, LTC2990_V1_MSB, DIFF)		\
+	X(CURR2, curr2, 1, LTC2990_V3_MSB, DIFF)		\
+	X(IN0, in0, 0, LTC2990_VCC_MSB, VCC)			\
+	X(IN1, in1, 1, LTC2990_V1_MSB, SINGLE)			\
+	X(IN2, in2, 2, LTC2990_V2_MSB, SINGLE)			\
+	X(IN3, in3, 3, LTC2990_V3_MSB, SINGLE)			\
+	X(IN4, in4, 4, LTC2990_V4_MSB, SINGLE)
+
+#define LTC2990_CHAN_ENUM(_id, _name, _index, _reg, _conv)	\
+	LTC2990_##_id,
+
+enum ltc2990_chan_id {
+	LTC2990_CHANNELS(LTC2990_CHAN_ENUM)
+	LTC2990_NUM_CHANNELS
+};
+
+struct ltc2990_chan {
+	u8 reg;
+	u8 sign;
+	u16 mask;
+	s32 num;
+	s32 den;
+	s32 offset;
+};
+
+#define LTC2990_CHAN_DESC(_id, _name, _index, _reg, _conv)	\
+	[LTC2990_##_id] = { .reg = (_reg), LTC2990_CONV_##_conv },
+
+static const struct ltc2990_chan ltc2990_chans[LTC2990_NUM_CHANNELS] = {
+	LTC2990_CHANNELS(LTC2990_CHAN_DESC)
+};
+
+/* Attribute name prefix of each channel, for tables of channel names */
+#define LTC2990_CHAN_NAME(_id, _name, _index, _reg, _conv)	\
+	[LTC2990_##_id] = #_name,
+
+/* Internal temperature and Vcc are measured in every mode */
+#define LTC2990_MODE_ALWAYS	(BIT(LTC2990_TEMP1) | BIT(LTC2990_IN0))
+
+/* Channels measured in each mode, indexed by CONTROL[2:0] */
+static const unsigned long ltc2990_mode_chans[LTC2990_NUM_MODES] = {
+	/* V1, V2, TR2 */
+	LTC2990_MODE_ALWAYS | BIT(LTC2990_IN1) | BIT(LTC2990_IN2) |
+		BIT(LTC2990_TEMP3),
+	/* V1-V2, TR2 */
+	LTC2990_MODE_ALWAYS | BIT(LTC2990_CURR1) | BIT(LTC2990_TEMP3),
+	/* V1-V2, V3, V4 */
+	LTC2990_MODE_ALWAYS | BIT(LTC2990_CURR1) | BIT(LTC2990_IN3) |
+		BIT(LTC2990_IN4),
+	/* TR1, V3, V4 */
+	LTC2990_MODE_ALWAYS | BIT(LTC2990_TEMP2) | BIT(LTC2990_IN3) |
+		BIT(LTC2990_IN4),
+	/* TR1, V3-V4 */
+	LTC2990_MODE_ALWAYS | BIT(LTC2990_TEMP2) | BIT(LTC2990_CURR2),
+	/* TR1, TR2 */
+	LTC2990_MODE_ALWAYS | BIT(LTC2990_TEMP2) | BIT(LTC2990_TEMP3),
+	/* V1-V2, V3-V4 */
+	LTC2990_MODE_ALWAYS | BIT(LTC2990_CURR1) | BIT(LTC2990_CURR2),
+	/* V1, V2, V3, V4 */
+	LTC2990_MODE_ALWAYS | BIT(LTC2990_IN1) | BIT(LTC2990_IN2) |
+		BIT(LTC2990_IN3) | BIT(LTC2990_IN4),
+};
+
+/* Measurement registers TINT_MSB up to VCC_LSB, fetched in one block read */
+#define LTC2990_BLOCK_LEN	(LTC2990_NUM_REGS * 2)
+
+/* Split a block read of TINT_MSB up to VCC_LSB into register values */
+static inline void ltc2990_unpack_block(const u8 buf[LTC2990_BLOCK_LEN],
+					u16 raw[LTC2990_NUM_REGS])
+{
+	int i;
+
+	for (i = 0; i < LTC2990_NUM_REGS; i++)
+		raw[i] = buf[2 * i] << 8 | buf[2 * i + 1];
+}
+
+/* Convert a raw register value to uV, mV or mC, see LTC2990_CONV_* */
+static inline int ltc2990_convert(const struct ltc2990_chan *chan, int raw)
+{
+	return sign_extend32(raw & chan->mask, chan->sign) * chan->num /
+	       chan->den + chan->offset;
+}
+
+#endif /* _LTC2990_CONV_H */
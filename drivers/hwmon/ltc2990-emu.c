@@ -0,0 +1,972 @@
+/*
+ * Emulated I2C buses populated with LTC2990 power monitors
+ *
+ * Copyright (C) 2014 Topic Embedded Products
+ *
+ * License: GPLv2
+ *
+ * Registers virtual SMBus adapters, each carrying up to LTC2990_EMU_ADDRS
+ * emulated LTC2990 chips, so the ltc2990 driver can be exercised and
+ * benchmarked without hardware. The chips implement the CONTROL and
+ * TRIGGER registers, repeated acquisition and the data valid flags that
+ * reads clear, and return plausible, per-chip distinct measurements.
+ * Optionally all bus segments sit behind a single emulated mux, which
+ * keeps its last channel selected like a PCA954x and counts selections.
+ *
+ * A fault profile, written to the profile parameter at any time, adds
+ * randomly distributed transaction delays, NAKs, conversions stuck busy,
+ * corrupted data and chip resets, to test the driver against slow and
+ * failing buses.
+ *
+ * Instead of the synthetic measurements the chips can replay a register
+ * trace recorded from real hardware, loaded as firmware, with its
+ * original timing.
+ */
+
+#include <linux/delay.h>
+#include <linux/err.h>
+#include <linux/firmware.h>
+#include <linux/i2c.h>
+#include <linux/i2c-mux.h>
+#include <linux/jiffies.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/ltc2990.h>
+#include <linux/module.h>
+#include <linux/platform_device.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+
+#include "ltc2990-conv.h"
+
+/* Register pointer range; addresses wrap around within it */
+#define LTC2990_EMU_REG_SPACE	0x10
+#define LTC2990_EMU_REG(addr)	((addr) & (LTC2990_EMU_REG_SPACE - 1))
+
+#define LTC2990_STATUS_BUSY		BIT(0)
+
+/* Chips are placed at consecutive addresses starting here */
+#define LTC2990_EMU_FIRST_ADDR	0x08
+#define LTC2990_EMU_ADDRS	(0x78 - LTC2990_EMU_FIRST_ADDR)
+
+/* Upper bound of an injected delay, and default length of a stall */
+#define LTC2990_EMU_DELAY_MAX_US	1000000
+#define LTC2990_EMU_STUCK_MS		100
+
+#define LTC2990_EMU_PPM			1000000
+
+enum ltc2990_emu_dist {
+	LTC2990_EMU_DIST_NONE,
+	LTC2990_EMU_DIST_FIXED,		/* a us */
+	LTC2990_EMU_DIST_UNIFORM,	/* a to b us */
+	LTC2990_EMU_DIST_EXP,		/* exponential, mean a us */
+	LTC2990_EMU_DIST_BIMODAL,	/* a us, b us with probability p */
+};
+
+static const char * const ltc2990_emu_dists[] = {
+	[LTC2990_EMU_DIST_NONE]		= "none",
+	[LTC2990_EMU_DIST_FIXED]	= "fixed",
+	[LTC2990_EMU_DIST_UNIFORM]	= "uniform",
+	[LTC2990_EMU_DIST_EXP]		= "exp",
+	[LTC2990_EMU_DIST_BIMODAL]	= "bimodal",
+};
+
+/* Number of colon separated arguments of each distribution */
+static const u8 ltc2990_emu_dist_args[] = { 0, 1, 2, 1, 3 };
+
+/* Faults injected per transaction, probabilities in parts per million */
+struct ltc2990_emu_profile {
+	u8 dist;
+	u32 a, b, p;
+	u32 nak;
+	u32 corrupt;
+	u32 stuck;
+	u32 stuck_ms;
+	u32 brownout;
+};
+
+struct ltc2990_emu_chip {
+	unsigned int id;
+	u8 regs[LTC2990_EMU_REG_SPACE];
+	unsigned int replay_pos;	/* last replayed trace record */
+	bool latched;			/* replay_pos is in the registers */
+	ktime_t converted;		/* end of the last conversion */
+	u8 ptr;				/* register pointer for plain I2C */
+	bool stuck;			/* conversion stalled, STATUS busy */
+	unsigned long stuck_until;	/* in jiffies */
+};
+
+/* A bus segment carrying emulated chips */
+struct ltc2990_emu_seg {
+	struct i2c_adapter *adap;	/* adapter the chips are reached on */
+	unsigned int nr_chips;
+	struct ltc2990_emu_chip chips[LTC2990_EMU_ADDRS];
+	struct i2c_client *clients[LTC2990_EMU_ADDRS];
+};
+
+/* A registered adapter, carrying either one segment or the mux */
+struct ltc2990_emu_root {
+	struct i2c_adapter adap;
+	struct ltc2990_emu_seg *seg;	/* directly attached, or NULL */
+	struct i2c_mux_core *muxc;
+	int selected;			/* mux channel, -1 for none */
+};
+
+static unsigned int devices = 1;
+module_param(devices, uint, S_IRUGO);
+MODULE_PARM_DESC(devices, "Total number of emulated LTC2990 chips");
+
+static unsigned int per_bus = 4;
+module_param(per_bus, uint, S_IRUGO);
+MODULE_PARM_DESC(per_bus, "Chips per emulated adapter (max 112)");
+
+static bool clients = true;
+module_param(clients, bool, S_IRUGO);
+MODULE_PARM_DESC(clients,
+		 "Instantiate ltc2990 clients, otherwise use new_device");
+
+static bool block = true;
+module_param(block, bool, S_IRUGO);
+MODULE_PARM_DESC(block, "Support I2C block reads, otherwise SMBus only");
+
+static unsigned int cycle_ms = 50;
+module_param(cycle_ms, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(cycle_ms, "Conversion cycle in repeated acquisition mode");
+
+static unsigned int delay_us;
+module_param(delay_us, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(delay_us, "Added latency per transaction in us");
+
+static bool mux;
+module_param(mux, bool, S_IRUGO);
+MODULE_PARM_DESC(mux, "Put every bus segment behind one emulated mux");
+
+static unsigned long mux_switches;
+module_param(mux_switches, ulong, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(mux_switches, "Channel selections made by the mux");
+
+static bool interleave;
+module_param(interleave, bool, S_IRUGO);
+MODULE_PARM_DESC(interleave,
+		 "Instantiate clients round-robin across segments");
+
+static char *replay;
+module_param(replay, charp, S_IRUGO);
+MODULE_PARM_DESC(replay, "Firmware file with a register trace to replay");
+
+static unsigned int replay_stagger;
+module_param(replay_stagger, uint, S_IRUGO);
+MODULE_PARM_DESC(replay_stagger,
+		 "Offset in ms between the trace positions of successive chips");
+
+static unsigned long naks;
+module_param(naks, ulong, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(naks, "Transactions NAKed by the fault profile");
+
+static unsigned long corruptions;
+module_param(corruptions, ulong, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(corruptions, "Reads corrupted by the fault profile");
+
+static unsigned long stalls;
+module_param(stalls, ulong, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(stalls, "Conversions stalled by the fault profile");
+
+static unsigned long brownouts;
+module_param(brownouts, ulong, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(brownouts, "Chip resets caused by the fault profile");
+
+static DEFINE_SPINLOCK(ltc2990_emu_profile_lock);
+static struct ltc2990_emu_profile ltc2990_emu_profile = {
+	.stuck_ms = LTC2990_EMU_STUCK_MS,
+};
+
+/* Parse up to n colon separated numbers, returns how many were found */
+static int ltc2990_emu_parse_args(char *s, u32 *v, int n)
+{
+	char *tok;
+	int i = 0;
+
+	while ((tok = strsep(&s, ":"))) {
+		if (i == n || kstrtou32(tok, 0, &v[i++]))
+			return -EINVAL;
+	}
+
+	return i;
+}
+
+static int ltc2990_emu_parse_delay(char *s, struct ltc2990_emu_profile *p)
+{
+	char *name = strsep(&s, ":");
+	u32 v[3] = { 0 };
+	int dist, n = 0;
+
+	dist = match_string(ltc2990_emu_dists, ARRAY_SIZE(ltc2990_emu_dists),
+			    name);
+	if (dist < 0)
+		return dist;
+	if (s)
+		n = ltc2990_emu_parse_args(s, v, ARRAY_SIZE(v));
+	if (n != ltc2990_emu_dist_args[dist])
+		return -EINVAL;
+	if (dist == LTC2990_EMU_DIST_UNIFORM && v[1] < v[0])
+		return -EINVAL;
+
+	p->dist = dist;
+	p->a = min_t(u32, v[0], LTC2990_EMU_DELAY_MAX_US);
+	p->b = min_t(u32, v[1], LTC2990_EMU_DELAY_MAX_US);
+	p->p = v[2];
+
+	return 0;
+}
+
+/*
+ * The profile is a space separated list of
+ *   delay=none|fixed:<us>|uniform:<min>:<max>|exp:<mean>|
+ *	   bimodal:<us>:<slow us>:<slow ppm>
+ *   nak=<ppm> corrupt=<ppm> stuck=<ppm>[:<ms>] brownout=<ppm>
+ * Anything not given is off, so an empty string clears the profile.
+ */
+static int ltc2990_emu_profile_set(const char *val,
+				   const struct kernel_param *kp)
+{
+	struct ltc2990_emu_profile p = { .stuck_ms = LTC2990_EMU_STUCK_MS };
+	char *buf, *s, *tok;
+	int ret = 0;
+
+	buf = kstrdup(val, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	s = strim(buf);
+	while (!ret && (tok = strsep(&s, " \t"))) {
+		char *key = strsep(&tok, "=");
+		u32 v[2];
+
+		if (!*key)
+			continue;
+		if (!tok)
+			ret = -EINVAL;
+		else if (!strcmp(key, "delay"))
+			ret = ltc2990_emu_parse_delay(tok, &p);
+		else if (!strcmp(key, "nak"))
+			ret = kstrtou32(tok, 0, &p.nak);
+		else if (!strcmp(key, "corrupt"))
+			ret = kstrtou32(tok, 0, &p.corrupt);
+		else if (!strcmp(key, "brownout"))
+			ret = kstrtou32(tok, 0, &p.brownout);
+		else if (!strcmp(key, "stuck")) {
+			v[1] = p.stuck_ms;
+			ret = ltc2990_emu_parse_args(tok, v, ARRAY_SIZE(v));
+			ret = ret < 1 ? -EINVAL : 0;
+			p.stuck = v[0];
+			p.stuck_ms = v[1];
+		} else
+			ret = -EINVAL;
+	}
+	kfree(buf);
+	if (ret)
+		return ret;
+
+	if (p.nak > LTC2990_EMU_PPM || p.corrupt > LTC2990_EMU_PPM ||
+	    p.stuck > LTC2990_EMU_PPM || p.p > LTC2990_EMU_PPM ||
+	    p.brownout > LTC2990_EMU_PPM)
+		return -EINVAL;
+
+	spin_lock(&ltc2990_emu_profile_lock);
+	ltc2990_emu_profile = p;
+	spin_unlock(&ltc2990_emu_profile_lock);
+
+	return 0;
+}
+
+static int ltc2990_emu_profile_get(char *buffer, const struct kernel_param *kp)
+{
+	struct ltc2990_emu_profile p;
+	u32 v[3];
+	int len, i;
+
+	spin_lock(&ltc2990_emu_profile_lock);
+	p = ltc2990_emu_profile;
+	spin_unlock(&ltc2990_emu_profile_lock);
+
+	v[0] = p.a;
+	v[1] = p.b;
+	v[2] = p.p;
+	len = sprintf(buffer, "delay=%s", ltc2990_emu_dists[p.dist]);
+	for (i = 0; i < ltc2990_emu_dist_args[p.dist]; i++)
+		len += sprintf(buffer + len, ":%u", v[i]);
+
+	return len + sprintf(buffer + len,
+			     " nak=%u corrupt=%u stuck=%u:%u brownout=%u\n",
+			     p.nak, p.corrupt, p.stuck, p.stuck_ms, p.brownout);
+}
+
+static const struct kernel_param_ops ltc2990_emu_profile_ops = {
+	.set	= ltc2990_emu_profile_set,
+	.get	= ltc2990_emu_profile_get,
+};
+module_param_cb(profile, &ltc2990_emu_profile_ops, NULL, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(profile, "Fault profile, see Documentation/hwmon/ltc2990");
+
+static inline bool ltc2990_emu_chance(u32 ppm)
+{
+	return ppm && prandom_u32_max(LTC2990_EMU_PPM) < ppm;
+}
+
+/*
+ * -ln(U) for U uniform in (0, 1], in 1/1024 units. log2 is interpolated
+ * linearly between powers of two, close enough to shape a latency tail.
+ */
+static u32 ltc2990_emu_neglog(void)
+{
+	u32 x = prandom_u32() | 1;
+	int e = ilog2(x);
+	u32 frac = ((u64)(x - BIT(e)) << 10) >> e;
+
+	/* -log2(x / 2^32) = 32 - e - frac, ln(2) ~ 710 / 1024 */
+	return ((((32 - e) << 10) - frac) * 710) >> 10;
+}
+
+static u32 ltc2990_emu_delay(const struct ltc2990_emu_profile *p)
+{
+	u64 us;
+
+	switch (p->dist) {
+	case LTC2990_EMU_DIST_FIXED:
+		us = p->a;
+		break;
+	case LTC2990_EMU_DIST_UNIFORM:
+		us = p->a + prandom_u32_max(p->b - p->a + 1);
+		break;
+	case LTC2990_EMU_DIST_EXP:
+		us = ((u64)p->a * ltc2990_emu_neglog()) >> 10;
+		break;
+	case LTC2990_EMU_DIST_BIMODAL:
+		us = ltc2990_emu_chance(p->p) ? p->b : p->a;
+		break;
+	default:
+		us = 0;
+		break;
+	}
+
+	return min_t(u64, us + delay_us, LTC2990_EMU_DELAY_MAX_US);
+}
+
+static void ltc2990_emu_corrupt(u8 *buf, int len)
+{
+	buf[prandom_u32_max(len)] ^= BIT(prandom_u32_max(8));
+	corruptions++;
+}
+
+static struct ltc2990_emu_seg *ltc2990_emu_segs;
+static unsigned int ltc2990_emu_nr_segs;
+static struct ltc2990_emu_root *ltc2990_emu_roots;
+static unsigned int ltc2990_emu_nr_roots;
+static struct platform_device *ltc2990_emu_pdev;
+
+static const struct firmware *ltc2990_emu_fw;
+static const struct ltc2990_trace_rec *ltc2990_emu_recs;
+static unsigned int ltc2990_emu_nr_recs;
+static u64 ltc2990_emu_trace_us;	/* length of one pass of the trace */
+static ktime_t ltc2990_emu_start;
+
+static void ltc2990_emu_set(struct ltc2990_emu_chip *chip, u8 reg, u16 val)
+{
+	chip->regs[reg] = val >> 8;
+	chip->regs[reg + 1] = val & 0xff;
+}
+
+/* 14-bit sign/magnitude style voltage code as used by V1..V4 and Vcc */
+static u16 ltc2990_emu_voltage(int code)
+{
+	return LTC2990_DATA_VALID | (code & 0x7FFF);
+}
+
+/*
+ * Latch the trace record due at the current time. The trace loops, and
+ * successive chips are replay_stagger ms apart in it.
+ */
+static void ltc2990_emu_replay(struct ltc2990_emu_chip *chip)
+{
+	const struct ltc2990_trace_rec *recs = ltc2990_emu_recs;
+	unsigned int lo = 0, hi = ltc2990_emu_nr_recs;
+	u64 t, now;
+	int i;
+
+	t = ktime_us_delta(ktime_get(), ltc2990_emu_start) +
+	    (u64)chip->id * replay_stagger * USEC_PER_MSEC;
+	div64_u64_rem(t, ltc2990_emu_trace_us, &now);
+
+	/* usually still the same or the next record */
+	i = chip->replay_pos;
+	if (le64_to_cpu(recs[i].t_us) <= now &&
+	    (i + 1 == hi || le64_to_cpu(recs[i + 1].t_us) > now)) {
+		lo = i;
+	} else if (i + 1 < hi && le64_to_cpu(recs[i + 1].t_us) <= now &&
+		   (i + 2 == hi || le64_to_cpu(recs[i + 2].t_us) > now)) {
+		lo = i + 1;
+	} else {
+		/* last record at or before now, the first one is at 0 */
+		while (hi - lo > 1) {
+			unsigned int mid = lo + (hi - lo) / 2;
+
+			if (le64_to_cpu(recs[mid].t_us) <= now)
+				lo = mid;
+			else
+				hi = mid;
+		}
+	}
+	/* data valid is cleared by reads until the next record is due */
+	if (chip->latched && lo == chip->replay_pos)
+		return;
+	chip->replay_pos = lo;
+	chip->latched = true;
+
+	for (i = 0; i < ARRAY_SIZE(recs[lo].raw); i++)
+		ltc2990_emu_set(chip, LTC2990_TINT_MSB + 2 * i,
+				le16_to_cpu(recs[lo].raw[i]));
+}
+
+/* Latch a new set of measurements, as the chip does after a conversion */
+static void ltc2990_emu_convert(struct ltc2990_emu_chip *chip)
+{
+	int mode = chip->regs[LTC2990_CONTROL] & LTC2990_CONTROL_MODE_MASK;
+	int id = chip->id;
+
+	chip->converted = ktime_get();
+	if (ltc2990_emu_recs) {
+		chip->latched = false;
+		ltc2990_emu_replay(chip);
+		return;
+	}
+
+	/* 25 degrees plus a little per chip, 0.0625 degrees/LSB */
+	ltc2990_emu_set(chip, LTC2990_TINT_MSB,
+			LTC2990_DATA_VALID | ((25 * 16 + id) & 0x1FFF));
+
+	/* CONTROL[4:3] clear, as after power on: die temperature only */
+	if (!(chip->regs[LTC2990_CONTROL] & LTC2990_CONTROL_MEASURE_ALL))
+		return;
+
+	if (mode == LTC2990_CONTROL_MODE_CURRENT) {
+		/* differential inputs, 19.42uV/LSB, around 10mV and -5mV */
+		ltc2990_emu_set(chip, LTC2990_V1_MSB,
+				ltc2990_emu_voltage(515 + id));
+		ltc2990_emu_set(chip, LTC2990_V3_MSB,
+				ltc2990_emu_voltage(-257 - id));
+	} else {
+		/* single ended inputs, 305.18uV/LSB, 1.0V to 1.8V */
+		ltc2990_emu_set(chip, LTC2990_V1_MSB,
+				ltc2990_emu_voltage(3277 + id));
+		ltc2990_emu_set(chip, LTC2990_V2_MSB,
+				ltc2990_emu_voltage(3932 + id));
+		ltc2990_emu_set(chip, LTC2990_V3_MSB,
+				ltc2990_emu_voltage(4915 + id));
+		ltc2990_emu_set(chip, LTC2990_V4_MSB,
+				ltc2990_emu_voltage(5898 + id));
+	}
+
+	/* 3.3V supply, 2.5V offset */
+	ltc2990_emu_set(chip, LTC2990_VCC_MSB, ltc2990_emu_voltage(2621));
+}
+
+static void ltc2990_emu_write(struct ltc2990_emu_chip *chip, u8 reg, u8 val)
+{
+	switch (reg) {
+	case LTC2990_CONTROL:
+		chip->regs[reg] = val;
+		break;
+	case LTC2990_TRIGGER:
+		if (!chip->stuck)
+			ltc2990_emu_convert(chip);
+		break;
+	default:
+		break;	/* data registers are read only */
+	}
+}
+
+/* A stalled chip reports busy and no valid data until it recovers */
+static u8 ltc2990_emu_read(struct ltc2990_emu_chip *chip, u8 reg)
+{
+	u8 val = chip->regs[reg];
+
+	/* like the real chip, reading a measurement clears its data valid */
+	if (reg >= LTC2990_TINT_MSB && !(reg & 1)) {
+		chip->regs[reg] &= ~(LTC2990_DATA_VALID >> 8);
+		if (chip->stuck)
+			return val & ~(LTC2990_DATA_VALID >> 8);
+	}
+	if (chip->stuck && reg == LTC2990_STATUS)
+		return val | LTC2990_STATUS_BUSY;
+
+	return val;
+}
+
+static void ltc2990_emu_stall(struct ltc2990_emu_chip *chip,
+			      const struct ltc2990_emu_profile *p)
+{
+	if (ltc2990_emu_chance(p->stuck)) {
+		chip->stuck = true;
+		chip->stuck_until = jiffies + msecs_to_jiffies(p->stuck_ms);
+		stalls++;
+	} else if (chip->stuck && time_after_eq(jiffies, chip->stuck_until)) {
+		chip->stuck = false;
+	}
+}
+
+static struct ltc2990_emu_chip *ltc2990_emu_find(struct ltc2990_emu_root *root,
+						 u16 addr)
+{
+	struct ltc2990_emu_seg *seg = root->seg;
+	unsigned int idx = addr - LTC2990_EMU_FIRST_ADDR;
+
+	if (root->muxc)
+		seg = root->selected < 0 ? NULL :
+		      &ltc2990_emu_segs[root->selected];
+
+	if (!seg || addr < LTC2990_EMU_FIRST_ADDR || idx >= seg->nr_chips)
+		return NULL;
+
+	return &seg->chips[idx];
+}
+
+/*
+ * Delay and faults of the profile, applied at the start of every
+ * transaction. Returns -ENXIO for an injected NAK.
+ */
+static int ltc2990_emu_begin(struct ltc2990_emu_chip *chip, bool read,
+			     bool *corrupt)
+{
+	struct ltc2990_emu_profile prof;
+	u32 us;
+
+	spin_lock(&ltc2990_emu_profile_lock);
+	prof = ltc2990_emu_profile;
+	spin_unlock(&ltc2990_emu_profile_lock);
+
+	/* a NAK ends the transaction at the address byte */
+	if (ltc2990_emu_chance(prof.nak)) {
+		naks++;
+		return -ENXIO;
+	}
+
+	us = ltc2990_emu_delay(&prof);
+	if (us)
+		usleep_range(us, us + us / 8 + 1);
+
+	/* power on defaults, with no measurement latched yet */
+	if (ltc2990_emu_chance(prof.brownout)) {
+		memset(chip->regs, 0, sizeof(chip->regs));
+		chip->stuck = false;
+		brownouts++;
+	}
+
+	ltc2990_emu_stall(chip, &prof);
+	*corrupt = read && ltc2990_emu_chance(prof.corrupt);
+
+	/*
+	 * A replaying chip converts continuously. Otherwise repeated
+	 * acquisition latches new measurements every cycle_ms, checked
+	 * lazily when the chip is read.
+	 */
+	if (chip->stuck || !read)
+		return 0;
+	if (ltc2990_emu_recs)
+		ltc2990_emu_replay(chip);
+	else if (!(chip->regs[LTC2990_CONTROL] & LTC2990_CONTROL_SINGLE) &&
+		 ktime_us_delta(ktime_get(), chip->converted) >=
+		 (s64)cycle_ms * USEC_PER_MSEC)
+		ltc2990_emu_convert(chip);
+
+	return 0;
+}
+
+static s32 ltc2990_emu_xfer(struct i2c_adapter *adap, u16 addr,
+			    unsigned short flags, char read_write,
+			    u8 command, int size, union i2c_smbus_data *data)
+{
+	struct ltc2990_emu_root *root = i2c_get_adapdata(adap);
+	struct ltc2990_emu_chip *chip = ltc2990_emu_find(root, addr);
+	u8 reg = LTC2990_EMU_REG(command);
+	bool corrupt;
+	int ret;
+
+	if (!chip)
+		return -ENXIO;
+
+	ret = ltc2990_emu_begin(chip, read_write == I2C_SMBUS_READ, &corrupt);
+	if (ret)
+		return ret;
+
+	switch (size) {
+	case I2C_SMBUS_BYTE_DATA:
+		if (read_write == I2C_SMBUS_WRITE) {
+			ltc2990_emu_write(chip, reg, data->byte);
+			break;
+		}
+		data->byte = ltc2990_emu_read(chip, reg);
+		if (corrupt)
+			ltc2990_emu_corrupt(&data->byte, 1);
+		break;
+	case I2C_SMBUS_WORD_DATA: {
+		u8 buf[2];
+
+		if (read_write == I2C_SMBUS_WRITE)
+			return -EOPNOTSUPP;
+		buf[0] = ltc2990_emu_read(chip, reg);
+		buf[1] = ltc2990_emu_read(chip, LTC2990_EMU_REG(reg + 1));
+		if (corrupt)
+			ltc2990_emu_corrupt(buf, sizeof(buf));
+		/* the chip sends the MSB first */
+		data->word = buf[0] | buf[1] << 8;
+		break;
+	}
+	case I2C_SMBUS_I2C_BLOCK_DATA: {
+		int len = min_t(int, data->block[0], I2C_SMBUS_BLOCK_MAX);
+		int i;
+
+		if (!block || read_write == I2C_SMBUS_WRITE)
+			return -EOPNOTSUPP;
+		/* the register pointer wraps after VCC_LSB */
+		for (i = 0; i < len; i++)
+			data->block[i + 1] =
+				ltc2990_emu_read(chip, LTC2990_EMU_REG(reg + i));
+		if (corrupt && len)
+			ltc2990_emu_corrupt(&data->block[1], len);
+		break;
+	}
+	default:
+		return -EOPNOTSUPP;
+	}
+
+	return 0;
+}
+
+/*
+ * Plain I2C messages, as sent through i2c-dev I2C_RDWR. A write sets the
+ * register pointer and stores any further bytes from there on, a read
+ * continues from the pointer. A pointer write followed by a read counts
+ * as one transaction, like the SMBus equivalent.
+ */
+static int ltc2990_emu_master_xfer(struct i2c_adapter *adap,
+				   struct i2c_msg *msgs, int num)
+{
+	struct ltc2990_emu_root *root = i2c_get_adapdata(adap);
+	int i, j;
+
+	/* an SMBus-only adapter */
+	if (!block)
+		return -EOPNOTSUPP;
+
+	for (i = 0; i < num; i++) {
+		struct i2c_msg *msg = &msgs[i];
+		struct ltc2990_emu_chip *chip;
+		bool read = msg->flags & I2C_M_RD;
+		bool corrupt = false;
+		int ret;
+
+		chip = ltc2990_emu_find(root, msg->addr);
+		if (!chip)
+			return -ENXIO;
+
+		if (read || msg->len > 1) {
+			ret = ltc2990_emu_begin(chip, read, &corrupt);
+			if (ret)
+				return ret;
+		}
+
+		if (read) {
+			for (j = 0; j < msg->len; j++)
+				msg->buf[j] = ltc2990_emu_read(chip,
+					LTC2990_EMU_REG(chip->ptr + j));
+			if (corrupt && msg->len)
+				ltc2990_emu_corrupt(msg->buf, msg->len);
+		} else if (msg->len) {
+			chip->ptr = LTC2990_EMU_REG(msg->buf[0]);
+			for (j = 1; j < msg->len; j++)
+				ltc2990_emu_write(chip,
+					LTC2990_EMU_REG(chip->ptr + j - 1),
+					msg->buf[j]);
+		}
+	}
+
+	return num;
+}
+
+static u32 ltc2990_emu_func(struct i2c_adapter *adap)
+{
+	u32 func = I2C_FUNC_SMBUS_BYTE_DATA | I2C_FUNC_SMBUS_WORD_DATA;
+
+	if (block)
+		func |= I2C_FUNC_I2C | I2C_FUNC_SMBUS_READ_I2C_BLOCK;
+
+	return func;
+}
+
+static const struct i2c_algorithm ltc2990_emu_algorithm = {
+	.master_xfer	= ltc2990_emu_master_xfer,
+	.functionality	= ltc2990_emu_func,
+	.smbus_xfer	= ltc2990_emu_xfer,
+};
+
+/* Selecting a new channel costs two extra transactions on a real mux */
+static int ltc2990_emu_select(struct i2c_mux_core *muxc, u32 chan)
+{
+	struct ltc2990_emu_root *root = muxc->priv;
+
+	if (root->selected == chan)
+		return 0;
+
+	if (delay_us)
+		usleep_range(2 * delay_us, 2 * delay_us + delay_us / 4 + 1);
+	root->selected = chan;
+	mux_switches++;
+
+	return 0;
+}
+
+static int ltc2990_emu_mux_add(struct ltc2990_emu_root *root)
+{
+	int ret;
+	int i;
+
+	root->muxc = i2c_mux_alloc(&root->adap, &ltc2990_emu_pdev->dev,
+				   ltc2990_emu_nr_segs, 0, 0,
+				   ltc2990_emu_select, NULL);
+	if (!root->muxc)
+		return -ENOMEM;
+	root->muxc->priv = root;
+
+	for (i = 0; i < ltc2990_emu_nr_segs; i++) {
+		ret = i2c_mux_add_adapter(root->muxc, 0, i, I2C_CLASS_HWMON);
+		if (ret)
+			return ret;
+		ltc2990_emu_segs[i].adap = root->muxc->adapter[i];
+	}
+
+	return 0;
+}
+
+static int ltc2990_emu_root_add(struct ltc2990_emu_root *root,
+				unsigned int index)
+{
+	root->selected = -1;
+	root->adap.owner = THIS_MODULE;
+	root->adap.class = I2C_CLASS_HWMON;
+	root->adap.algo = &ltc2990_emu_algorithm;
+	i2c_set_adapdata(&root->adap, root);
+
+	if (mux) {
+		snprintf(root->adap.name, sizeof(root->adap.name),
+			 "ltc2990-emu mux");
+	} else {
+		root->seg = &ltc2990_emu_segs[index];
+		root->seg->adap = &root->adap;
+		snprintf(root->adap.name, sizeof(root->adap.name),
+			 "ltc2990-emu %u", index);
+	}
+
+	return i2c_add_adapter(&root->adap);
+}
+
+static int ltc2990_emu_client_add(struct ltc2990_emu_seg *seg, int i)
+{
+	struct i2c_board_info info = {
+		I2C_BOARD_INFO("ltc2990", LTC2990_EMU_FIRST_ADDR + i),
+	};
+
+	seg->clients[i] = i2c_new_device(seg->adap, &info);
+
+	return seg->clients[i] ? 0 : -ENODEV;
+}
+
+/* Probe order is segment by segment, or round-robin with interleave */
+static int ltc2990_emu_populate(void)
+{
+	struct ltc2990_emu_seg *segs = ltc2990_emu_segs;
+	int ret;
+	int i, j;
+
+	if (!interleave) {
+		for (i = 0; i < ltc2990_emu_nr_segs; i++) {
+			for (j = 0; j < segs[i].nr_chips; j++) {
+				ret = ltc2990_emu_client_add(&segs[i], j);
+				if (ret)
+					return ret;
+			}
+		}
+		return 0;
+	}
+
+	for (j = 0; j < per_bus; j++) {
+		for (i = 0; i < ltc2990_emu_nr_segs; i++) {
+			if (j >= segs[i].nr_chips)
+				continue;
+			ret = ltc2990_emu_client_add(&segs[i], j);
+			if (ret)
+				return ret;
+		}
+	}
+
+	return 0;
+}
+
+static int ltc2990_emu_replay_load(void)
+{
+	const struct ltc2990_trace_hdr *hdr;
+	unsigned int i, count;
+	int ret;
+
+	ret = request_firmware(&ltc2990_emu_fw, replay,
+			       &ltc2990_emu_pdev->dev);
+	if (ret)
+		return ret;
+
+	hdr = (const struct ltc2990_trace_hdr *)ltc2990_emu_fw->data;
+	if (ltc2990_emu_fw->size < sizeof(*hdr) ||
+	    le32_to_cpu(hdr->magic) != LTC2990_TRACE_MAGIC ||
+	    le16_to_cpu(hdr->version) != LTC2990_TRACE_VERSION)
+		goto invalid;
+
+	count = le32_to_cpu(hdr->count);
+	if (!count || count > (ltc2990_emu_fw->size - sizeof(*hdr)) /
+			      sizeof(struct ltc2990_trace_rec))
+		goto invalid;
+
+	ltc2990_emu_recs = (const struct ltc2990_trace_rec *)(hdr + 1);
+	if (le64_to_cpu(ltc2990_emu_recs[0].t_us))
+		goto invalid;
+	for (i = 1; i < count; i++)
+		if (le64_to_cpu(ltc2990_emu_recs[i].t_us) <
+		    le64_to_cpu(ltc2990_emu_recs[i - 1].t_us))
+			goto invalid;
+
+	/* the last record lasts as long as the average one */
+	ltc2990_emu_nr_recs = count;
+	ltc2990_emu_trace_us = le64_to_cpu(ltc2990_emu_recs[count - 1].t_us);
+	ltc2990_emu_trace_us += count > 1 ?
+				div_u64(ltc2990_emu_trace_us, count - 1) : 1;
+	ltc2990_emu_trace_us = max_t(u64, ltc2990_emu_trace_us, 1);
+	ltc2990_emu_start = ktime_get();
+
+	dev_info(&ltc2990_emu_pdev->dev, "replaying %u records, %llu ms\n",
+		 count, div_u64(ltc2990_emu_trace_us, USEC_PER_MSEC));
+	return 0;
+
+invalid:
+	dev_err(&ltc2990_emu_pdev->dev, "%s: not an LTC2990 trace\n", replay);
+	ltc2990_emu_recs = NULL;
+	release_firmware(ltc2990_emu_fw);
+	ltc2990_emu_fw = NULL;
+	return -EINVAL;
+}
+
+static void ltc2990_emu_cleanup(void)
+{
+	int i, j;
+
+	for (i = 0; i < ltc2990_emu_nr_segs; i++)
+		for (j = 0; j < ltc2990_emu_segs[i].nr_chips; j++)
+			if (ltc2990_emu_segs[i].clients[j])
+				i2c_unregister_device(
+					ltc2990_emu_segs[i].clients[j]);
+
+	while (ltc2990_emu_nr_roots) {
+		struct ltc2990_emu_root *root =
+			&ltc2990_emu_roots[--ltc2990_emu_nr_roots];
+
+		if (root->muxc)
+			i2c_mux_del_adapters(root->muxc);
+		i2c_del_adapter(&root->adap);
+	}
+
+	release_firmware(ltc2990_emu_fw);
+	if (ltc2990_emu_pdev)
+		platform_device_unregister(ltc2990_emu_pdev);
+	kfree(ltc2990_emu_roots);
+	kfree(ltc2990_emu_segs);
+}
+
+static int __init ltc2990_emu_init(void)
+{
+	unsigned int nr_roots;
+	unsigned int id = 0;
+	int ret;
+	int i, j;
+
+	if (!per_bus || per_bus > LTC2990_EMU_ADDRS)
+		return -EINVAL;
+
+	ltc2990_emu_pdev = platform_device_register_simple("ltc2990-emu", -1,
+							   NULL, 0);
+	if (IS_ERR(ltc2990_emu_pdev))
+		return PTR_ERR(ltc2990_emu_pdev);
+
+	if (replay) {
+		ret = ltc2990_emu_replay_load();
+		if (ret)
+			goto err;
+	}
+
+	ltc2990_emu_nr_segs = DIV_ROUND_UP(devices, per_bus);
+	ltc2990_emu_segs = kcalloc(ltc2990_emu_nr_segs,
+				   sizeof(*ltc2990_emu_segs), GFP_KERNEL);
+	nr_roots = mux ? 1 : ltc2990_emu_nr_segs;
+	ltc2990_emu_roots = kcalloc(nr_roots, sizeof(*ltc2990_emu_roots),
+				    GFP_KERNEL);
+	if (!ltc2990_emu_segs || !ltc2990_emu_roots) {
+		ret = -ENOMEM;
+		goto err;
+	}
+
+	for (i = 0; i < ltc2990_emu_nr_segs; i++) {
+		struct ltc2990_emu_seg *seg = &ltc2990_emu_segs[i];
+
+		seg->nr_chips = min(per_bus, devices - id);
+		for (j = 0; j < seg->nr_chips; j++) {
+			seg->chips[j].id = id++;
+			ltc2990_emu_convert(&seg->chips[j]);
+		}
+	}
+
+	for (i = 0; i < nr_roots; i++) {
+		ret = ltc2990_emu_root_add(&ltc2990_emu_roots[i], i);
+		if (ret)
+			goto err;
+		ltc2990_emu_nr_roots++;
+	}
+
+	if (mux) {
+		ret = ltc2990_emu_mux_add(&ltc2990_emu_roots[0]);
+		if (ret)
+			goto err;
+	}
+
+	if (!clients)
+		return 0;
+
+	ret = ltc2990_emu_populate();
+	if (ret)
+		goto err;
+
+	return 0;
+
+err:
+	ltc2990_emu_cleanup();
+	return ret;
+}
+module_init(ltc2990_emu_init);
+
+static void __exit ltc2990_emu_exit(void)
+{
+	ltc2990_emu_cleanup();
+}
+module_exit(ltc2990_emu_exit);
+
+MODULE_DESCRIPTION("Emulated LTC2990 buses for testing");
+MODULE_AUTHOR("Topic Embedded Products");
+MODULE_LICENSE("GPL v2");
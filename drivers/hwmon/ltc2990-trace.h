@@ -0,0 +1,127 @@
+/*
+ * Tracepoints of the LTC2990 driver
+ *
+ * Copyright (C) 2014 Topic Embedded Products
+ *
+ * License: GPLv2
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM ltc2990
+
+#if !defined(_LTC2990_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _LTC2990_TRACE_H
+
+#include <linux/i2c.h>
+#include <linux/tracepoint.h>
+
+#include "ltc2990-conv.h"
+
+/*
+ * Raw measurement registers TINT, V1-V4 and VCC as read by one cache
+ * refresh. mask has a bit set for every register actually read, the
+ * others are zero.
+ */
+TRACE_EVENT(ltc2990_raw,
+	TP_PROTO(const struct i2c_client *client, u8 mode, u8 mask,
+		 const u16 *raw),
+
+	TP_ARGS(client, mode, mask, raw),
+
+	TP_STRUCT__entry(
+		__field(int, adapter)
+		__field(u16, addr)
+		__field(u8, mode)
+		__field(u8, mask)
+		__array(u16, raw, LTC2990_NUM_REGS)
+	),
+
+	TP_fast_assign(
+		__entry->adapter = i2c_adapter_id(client->adapter);
+		__entry->addr = client->addr;
+		__entry->mode = mode;
+		__entry->mask = mask;
+		memcpy(__entry->raw, raw, sizeof(__entry->raw));
+	),
+
+	/* ltc2990-trace2replay parses this, one field per register */
+	TP_printk("%d-%04x mode=%u mask=0x%02x raw=%04x,%04x,%04x,%04x,%04x,%04x",
+		  __entry->adapter, __entry->addr, __entry->mode,
+		  __entry->mask, __entry->raw[0], __entry->raw[1],
+		  __entry->raw[2], __entry->raw[3], __entry->raw[4],
+		  __entry->raw[5])
+);
+
+/*
+ * One converted sample batch: every channel of the active mode from one
+ * cache refresh, with the raw registers it was converted from. valid has
+ * a bit per channel index of the uapi enum ltc2990_channel that holds a
+ * measurement, new or kept from an earlier refresh while the chip had not
+ * converted again; the values of the others are stale. BPF programs
+ * attached as a raw tracepoint get the arguments themselves, without the
+ * copy into the ring buffer.
+ */
+TRACE_EVENT(ltc2990_sample,
+	TP_PROTO(const struct i2c_client *client, u8 mode, u16 valid,
+		 u64 timestamp, const u16 *raw, const int *value),
+
+	TP_ARGS(client, mode, valid, timestamp, raw, value),
+
+	TP_STRUCT__entry(
+		__field(int, adapter)
+		__field(u16, addr)
+		__field(u8, mode)
+		__field(u16, valid)
+		__field(u64, timestamp)
+		__array(u16, raw, LTC2990_NUM_REGS)
+		__array(int, value, LTC2990_NUM_CHANNELS)
+	),
+
+	TP_fast_assign(
+		__entry->adapter = i2c_adapter_id(client->adapter);
+		__entry->addr = client->addr;
+		__entry->mode = mode;
+		__entry->valid = valid;
+		__entry->timestamp = timestamp;
+		memcpy(__entry->raw, raw, sizeof(__entry->raw));
+		memcpy(__entry->value, value, sizeof(__entry->value));
+	),
+
+	TP_printk("%d-%04x mode=%u valid=0x%03x t=%llu value=%d,%d,%d,%d,%d,%d,%d,%d,%d,%d",
+		  __entry->adapter, __entry->addr, __entry->mode,
+		  __entry->valid, __entry->timestamp, __entry->value[0],
+		  __entry->value[1], __entry->value[2], __entry->value[3],
+		  __entry->value[4], __entry->value[5], __entry->value[6],
+		  __entry->value[7], __entry->value[8], __entry->value[9])
+);
+
+/* End of a sampler scan, after every device had its sample event */
+TRACE_EVENT(ltc2990_scan,
+	TP_PROTO(unsigned long scan, unsigned int devices,
+		 unsigned int interval),
+
+	TP_ARGS(scan, devices, interval),
+
+	TP_STRUCT__entry(
+		__field(unsigned long, scan)
+		__field(unsigned int, devices)
+		__field(unsigned int, interval)
+	),
+
+	TP_fast_assign(
+		__entry->scan = scan;
+		__entry->devices = devices;
+		__entry->interval = interval;
+	),
+
+	TP_printk("scan=%lu devices=%u interval=%u",
+		  __entry->scan, __entry->devices, __entry->interval)
+);
+
+#endif /* _LTC2990_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE ltc2990-trace
+#include <trace/define_trace.h>
@@ -11,116 +11,2410 @@
  * the chip's internal temperature and Vcc power supply voltage.
  */
 
+#include <linux/atomic.h>
+#include <linux/bitops.h>
+#include <linux/cache.h>
+#include <linux/compat.h>
+#include <linux/completion.h>
+#include <linux/debugfs.h>
 #include <linux/err.h>
 #include <linux/hwmon.h>
 #include <linux/hwmon-sysfs.h>
 #include <linux/i2c.h>
+#include <linux/iio/iio.h>
+#include <linux/iio/sysfs.h>
+#include <linux/jiffies.h>
+#include <linux/jump_label.h>
 #include <linux/kernel.h>
+#include <linux/kref.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/ltc2990.h>
+#include <linux/miscdevice.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/uaccess.h>
+#include <linux/workqueue.h>
+#include <net/genetlink.h>
 
-#define LTC2990_STATUS	0x00
-#define LTC2990_CONTROL	0x01
-#define LTC2990_TRIGGER	0x02
-#define LTC2990_TINT_MSB	0x04
-#define LTC2990_V1_MSB	0x06
-#define LTC2990_V2_MSB	0x08
-#define LTC2990_V3_MSB	0x0A
-#define LTC2990_V4_MSB	0x0C
-#define LTC2990_VCC_MSB	0x0E
-
-#define LTC2990_CONTROL_KELVIN		BIT(7)
-#define LTC2990_CONTROL_SINGLE		BIT(6)
-#define LTC2990_CONTROL_MEASURE_ALL	(0x3 << 3)
-#define LTC2990_CONTROL_MODE_CURRENT	0x06
-#define LTC2990_CONTROL_MODE_VOLTAGE	0x07
-
-/* convert raw register value to sign-extended integer in 16-bit range */
-static int ltc2990_voltage_to_int(int raw)
-{
-	if (raw & BIT(14))
-		return -(0x4000 - (raw & 0x3FFF)) << 2;
+#include "ltc2990-conv.h"
+
+#define CREATE_TRACE_POINTS
+#include "ltc2990-trace.h"
+
+/* A full conversion cycle of all inputs completes well within this time */
+#define LTC2990_UPDATE_INTERVAL_DEFAULT	200	/* ms */
+#define LTC2990_UPDATE_INTERVAL_MIN	50	/* ms */
+
+/* Transactions timed per transfer type when characterizing the bus */
+#define LTC2990_PROBE_SAMPLES	4
+
+/*
+ * Default intervals keep periodic refreshes below 1/LTC2990_BUS_DUTY of
+ * the measured bus time.
+ */
+#define LTC2990_BUS_DUTY	100
+
+enum ltc2990_xfer {
+	LTC2990_XFER_WORD,	/* one SMBus word read per register */
+	LTC2990_XFER_BLOCK,	/* one I2C block read for all registers */
+};
+
+/* ltc2990_update() flags */
+#define LTC2990_UPDATE_FORCE	BIT(0)	/* refresh even if the cache is fresh */
+#define LTC2990_UPDATE_YIELD	BIT(1)	/* give way to other bus users */
+
+/* Latency histogram buckets, bucket n counts reads taking < 2^n ns */
+#define LTC2990_INSTR_BUCKETS	24
+
+/*
+ * Read latency instrumentation is patched out of the read path until
+ * enabled through debugfs, so the disabled cost is a single NOP. The event
+ * counters in the other debugfs files are not behind it and always kept.
+ */
+static DEFINE_STATIC_KEY_FALSE(ltc2990_instr_key);
+static struct dentry *ltc2990_debugfs_root;
+
+/* Per-device state comes from its own cache-line aligned slab cache */
+static struct kmem_cache *ltc2990_data_cache;
+
+struct ltc2990_instr {
+	atomic_long_t reads;
+	atomic_long_t errors;
+	atomic64_t total_ns;
+	atomic64_t max_ns;
+	atomic64_t last_ns;	/* ktime of the most recent read */
+	atomic64_t last_err_ns;	/* ktime of the most recent failed read */
+	atomic_t hist[LTC2990_INSTR_BUCKETS];
+};
+
+/* Longest median window of the glitch filter */
+#define LTC2990_FILTER_TAPS	7
+
+/* Glitch filter of one channel, see ltc2990_filter() */
+struct ltc2990_filter {
+	u32 slew;		/* in channel units, 0 disables the filter */
+	u8 window;		/* median length, 0 or odd 3 to FILTER_TAPS */
+	u8 fill;		/* samples in hist */
+	u8 pos;			/* next slot in hist */
+	bool rejected;		/* the previous sample was rejected */
+	int hist[LTC2990_FILTER_TAPS];
+	u32 rejects;
+};
+
+/*
+ * Everything a device needs lives in this one allocation. Fields used on
+ * every attribute read come first so they share the leading cache line;
+ * attribute groups, channel tables and conversion constants are shared
+ * const data and never copied per device.
+ */
+struct ltc2990_data {
+	struct i2c_client *i2c;
+	u8 mode;			/* CONTROL[2:0] */
+#ifdef CONFIG_SENSORS_LTC2990_CACHE
+	u8 xfer;			/* enum ltc2990_xfer */
+	bool valid;
+	bool recheck;			/* verify CONTROL on the next refresh */
+	unsigned long control_checked;	/* in jiffies */
+	u16 data_valid;			/* channels with the DV flag set */
+	unsigned long last_updated;	/* in jiffies */
+	unsigned long update_interval;	/* in jiffies */
+	int value[LTC2990_NUM_CHANNELS];
+	u64 timestamp;			/* ktime of the last refresh */
+	struct mutex update_lock;
+#endif
+#ifdef CONFIG_SENSORS_LTC2990_HISTORY
+	int lowest[LTC2990_NUM_CHANNELS];
+	int highest[LTC2990_NUM_CHANNELS];
+#endif
+#ifdef CONFIG_SENSORS_LTC2990_FILTER
+	struct ltc2990_filter filter[LTC2990_NUM_CHANNELS];
+#endif
+#ifdef CONFIG_SENSORS_LTC2990_CHARDEV
+	struct list_head cursors;	/* of open control device handles */
+#endif
+#ifdef CONFIG_SENSORS_LTC2990_SAMPLER
+	u8 deferred;			/* consecutive yielded refreshes */
+#endif
+	struct list_head node;		/* in ltc2990_devices */
+	struct kref ref;		/* the list's, and one per user off it */
+	struct completion released;	/* the last reference is gone */
+	unsigned int seq;		/* probe order */
+#ifdef CONFIG_SENSORS_LTC2990_CACHE
+	u32 word_ns;			/* measured cost of one word read */
+	u32 block_ns;			/* of one block read, 0 if unsupported */
+	u32 refresh_ns;			/* of a refresh with the chosen xfer */
+	u32 control_checks;
+	u32 resets;			/* chip resets detected and repaired */
+	u64 last_reset;			/* ktime of the last one */
+#endif
+	struct device *hwmon_dev;
+	u32 mode_switches;
+	u32 mode_switch_ns;		/* latency of the last mode switch */
+	u32 mode_switch_max_ns;
+	struct dentry *debugfs;
+	struct ltc2990_instr instr;
+} ____cacheline_aligned;
+
+static inline bool ltc2990_chan_active(struct ltc2990_data *data, int ch)
+{
+	return test_bit(ch, &ltc2990_mode_chans[data->mode]);
+}
+
+#ifdef CONFIG_SENSORS_LTC2990_HISTORY
+static void ltc2990_history_reset(struct ltc2990_data *data)
+{
+	int i;
+
+	for (i = 0; i < LTC2990_NUM_CHANNELS; i++) {
+		data->lowest[i] = INT_MAX;
+		data->highest[i] = INT_MIN;
+	}
+}
+
+static inline void ltc2990_history_update(struct ltc2990_data *data, int ch,
+					  int value)
+{
+	data->lowest[ch] = min(data->lowest[ch], value);
+	data->highest[ch] = max(data->highest[ch], value);
+}
+#else
+static inline void ltc2990_history_reset(struct ltc2990_data *data) {}
+static inline void ltc2990_history_update(struct ltc2990_data *data, int ch,
+					  int value) {}
+#endif
+
+#ifdef CONFIG_SENSORS_LTC2990_FILTER
+static const char *const ltc2990_chan_names[LTC2990_NUM_CHANNELS] = {
+	LTC2990_CHANNELS(LTC2990_CHAN_NAME)
+};
+
+static void ltc2990_filter_reset(struct ltc2990_data *data)
+{
+	int ch;
+
+	for (ch = 0; ch < LTC2990_NUM_CHANNELS; ch++) {
+		struct ltc2990_filter *f = &data->filter[ch];
+
+		f->fill = 0;
+		f->pos = 0;
+		f->rejected = false;
+	}
+}
+
+static int ltc2990_filter_median(const struct ltc2990_filter *f)
+{
+	int v[LTC2990_FILTER_TAPS];
+	int i, j;
+
+	/* insertion sort, the window is a handful of entries */
+	for (i = 0; i < f->fill; i++) {
+		int x = f->hist[i];
+
+		for (j = i; j > 0 && v[j - 1] > x; j--)
+			v[j] = v[j - 1];
+		v[j] = x;
+	}
+
+	return v[f->fill / 2];
+}
+
+/*
+ * Pass a new sample of channel ch through its glitch filter and return the
+ * value to cache. A sample further than slew from the reference is
+ * rejected and the reference is cached in its place. Without a window the
+ * reference is the previous sample and only single outliers are rejected;
+ * the second of two in a row is taken as a real step. With a window it is
+ * the median of the last window samples, rejected ones included, so runs
+ * of up to window / 2 outliers are rejected.
+ */
+static int ltc2990_filter(struct ltc2990_data *data, int ch, int val)
+{
+	struct ltc2990_filter *f = &data->filter[ch];
+	int ref;
+
+	if (!f->slew)
+		return val;
+
+	if (!f->window) {
+		if (f->fill && !f->rejected &&
+		    (u32)abs(val - f->hist[0]) > f->slew) {
+			f->rejected = true;
+			f->rejects++;
+			return f->hist[0];
+		}
+		f->rejected = false;
+		f->hist[0] = val;
+		f->fill = 1;
+		return val;
+	}
+
+	f->hist[f->pos] = val;
+	f->pos = (f->pos + 1) % f->window;
+	if (f->fill < f->window)
+		f->fill++;
+
+	ref = ltc2990_filter_median(f);
+	if ((u32)abs(val - ref) <= f->slew)
+		return val;
+
+	f->rejects++;
+	return ref;
+}
+
+static int ltc2990_filter_show(struct seq_file *s, void *unused)
+{
+	struct ltc2990_data *data = s->private;
+	int ch;
+
+	seq_puts(s, "channel\twindow\tslew\trejected\n");
+	mutex_lock(&data->update_lock);
+	for (ch = 0; ch < LTC2990_NUM_CHANNELS; ch++) {
+		const struct ltc2990_filter *f = &data->filter[ch];
+
+		seq_printf(s, "%s\t%u\t%u\t%u\n", ltc2990_chan_names[ch],
+			   f->window, f->slew, f->rejects);
+	}
+	mutex_unlock(&data->update_lock);
+
+	return 0;
+}
+
+static int ltc2990_filter_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ltc2990_filter_show, inode->i_private);
+}
+
+/* "<channel> <window> <slew>" configures a channel, "reset" the counters */
+static ssize_t ltc2990_filter_write(struct file *file,
+				    const char __user *ubuf, size_t count,
+				    loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct ltc2990_data *data = s->private;
+	unsigned int window, slew;
+	char buf[48], name[8];
+	int ch;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+	buf[count] = 0;
+
+	if (sysfs_streq(buf, "reset")) {
+		mutex_lock(&data->update_lock);
+		for (ch = 0; ch < LTC2990_NUM_CHANNELS; ch++)
+			data->filter[ch].rejects = 0;
+		mutex_unlock(&data->update_lock);
+		return count;
+	}
+
+	if (sscanf(buf, "%7s %u %u", name, &window, &slew) != 3)
+		return -EINVAL;
+	/* a median of one sample would filter nothing */
+	if (window && (window < 3 || window > LTC2990_FILTER_TAPS ||
+		       !(window & 1)))
+		return -EINVAL;
+	for (ch = 0; ch < LTC2990_NUM_CHANNELS; ch++)
+		if (!strcmp(name, ltc2990_chan_names[ch]))
+			break;
+	if (ch == LTC2990_NUM_CHANNELS)
+		return -EINVAL;
+
+	mutex_lock(&data->update_lock);
+	data->filter[ch].window = window;
+	data->filter[ch].slew = slew;
+	data->filter[ch].fill = 0;
+	data->filter[ch].pos = 0;
+	data->filter[ch].rejected = false;
+	mutex_unlock(&data->update_lock);
+
+	return count;
+}
+
+static const struct file_operations ltc2990_filter_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ltc2990_filter_open,
+	.read		= seq_read,
+	.write		= ltc2990_filter_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void ltc2990_filter_debugfs_init(struct ltc2990_data *data)
+{
+	debugfs_create_file("filter", S_IRUGO | S_IWUSR, data->debugfs, data,
+			    &ltc2990_filter_fops);
+}
+#else
+static inline void ltc2990_filter_reset(struct ltc2990_data *data) {}
+static inline int ltc2990_filter(struct ltc2990_data *data, int ch, int val)
+{
+	return val;
+}
+static inline void ltc2990_filter_debugfs_init(struct ltc2990_data *data) {}
+#endif
+
+/*
+ * All bound devices. They are kept grouped by root adapter and, within
+ * that, by bus segment, so a walk of the list reads all devices behind
+ * one mux channel before moving on to the next channel.
+ */
+static LIST_HEAD(ltc2990_devices);
+static DEFINE_MUTEX(ltc2990_devices_lock);
+static unsigned int ltc2990_nr_devices;
+static unsigned int ltc2990_probe_seq;
+
+/*
+ * A listed device may be used without ltc2990_devices_lock, e.g. for bus
+ * I/O, while holding a reference. Removal waits for the last one.
+ */
+static void ltc2990_device_release(struct kref *ref)
+{
+	struct ltc2990_data *data = container_of(ref, struct ltc2990_data, ref);
+
+	complete(&data->released);
+}
+
+static inline void ltc2990_device_get(struct ltc2990_data *data)
+{
+	kref_get(&data->ref);
+}
+
+static inline void ltc2990_device_put(struct ltc2990_data *data)
+{
+	kref_put(&data->ref, ltc2990_device_release);
+}
+
+#ifdef CONFIG_SENSORS_LTC2990_CHARDEV
+/*
+ * Every open handle of the control device has a cursor on every bound
+ * device, accumulating the refreshes since the handle's previous read.
+ * Cursors are fed by whichever refresh happens, sampler or attribute
+ * read, so reading them causes no bus traffic.
+ */
+struct ltc2990_cursor {
+	struct list_head dev_node;	/* in ltc2990_data.cursors */
+	struct list_head handle_node;	/* in ltc2990_handle.cursors */
+	struct ltc2990_handle *handle;
+	struct ltc2990_data *data;
+	u32 refreshes;
+	u64 t_first;
+	u64 t_last;
+	u32 count[LTC2990_NUM_CHANNELS];
+	int min[LTC2990_NUM_CHANNELS];
+	int max[LTC2990_NUM_CHANNELS];
+	s64 sum[LTC2990_NUM_CHANNELS];
+};
+
+struct ltc2990_handle {
+	struct list_head node;		/* in ltc2990_handles */
+	struct list_head cursors;
+	unsigned int nr_cursors;
+};
+
+/* Open handles, protected by ltc2990_devices_lock */
+static LIST_HEAD(ltc2990_handles);
+
+static void ltc2990_cursors_init(struct ltc2990_data *data)
+{
+	INIT_LIST_HEAD(&data->cursors);
+}
+
+/*
+ * Account the refresh just completed, called with update_lock held. Only
+ * the channels in fresh got a new conversion; the others repeat a sample
+ * the cursors have already seen.
+ */
+static void ltc2990_cursors_feed(struct ltc2990_data *data, u16 fresh)
+{
+	unsigned long chans = ltc2990_mode_chans[data->mode] & fresh;
+	struct ltc2990_cursor *c;
+	int ch;
+
+	list_for_each_entry(c, &data->cursors, dev_node) {
+		if (!c->refreshes++)
+			c->t_first = data->timestamp;
+		c->t_last = data->timestamp;
+
+		for_each_set_bit(ch, &chans, LTC2990_NUM_CHANNELS) {
+			int val = data->value[ch];
+
+			if (!c->count[ch]++) {
+				c->min[ch] = val;
+				c->max[ch] = val;
+			} else {
+				c->min[ch] = min(c->min[ch], val);
+				c->max[ch] = max(c->max[ch], val);
+			}
+			c->sum[ch] += val;
+		}
+	}
+}
+
+/* Attach a cursor on data to h, called with ltc2990_devices_lock held */
+static int ltc2990_cursor_add(struct ltc2990_handle *h,
+			      struct ltc2990_data *data)
+{
+	struct ltc2990_cursor *c;
+
+	c = kzalloc(sizeof(*c), GFP_KERNEL);
+	if (!c)
+		return -ENOMEM;
+	c->handle = h;
+	c->data = data;
+	list_add_tail(&c->handle_node, &h->cursors);
+	h->nr_cursors++;
+
+	mutex_lock(&data->update_lock);
+	list_add_tail(&c->dev_node, &data->cursors);
+	mutex_unlock(&data->update_lock);
+
+	return 0;
+}
+
+static void ltc2990_cursor_free(struct ltc2990_cursor *c)
+{
+	mutex_lock(&c->data->update_lock);
+	list_del(&c->dev_node);
+	mutex_unlock(&c->data->update_lock);
+	list_del(&c->handle_node);
+	c->handle->nr_cursors--;
+	kfree(c);
+}
+
+static void ltc2990_cursors_del(struct ltc2990_data *data)
+{
+	struct ltc2990_cursor *c, *tmp;
+
+	lockdep_assert_held(&ltc2990_devices_lock);
+
+	list_for_each_entry_safe(c, tmp, &data->cursors, dev_node)
+		ltc2990_cursor_free(c);
+}
+
+/* Give every open handle a cursor on a new device, before it is listed */
+static int ltc2990_cursors_add(struct ltc2990_data *data)
+{
+	struct ltc2990_handle *h;
+	int ret;
+
+	lockdep_assert_held(&ltc2990_devices_lock);
+
+	list_for_each_entry(h, &ltc2990_handles, node) {
+		ret = ltc2990_cursor_add(h, data);
+		if (ret) {
+			ltc2990_cursors_del(data);
+			return ret;
+		}
+	}
+
+	return 0;
+}
+#else
+static inline void ltc2990_cursors_init(struct ltc2990_data *data) {}
+static inline void ltc2990_cursors_feed(struct ltc2990_data *data,
+					u16 fresh) {}
+static inline int ltc2990_cursors_add(struct ltc2990_data *data)
+{
+	return 0;
+}
+static inline void ltc2990_cursors_del(struct ltc2990_data *data) {}
+#endif
+
+#ifdef CONFIG_SENSORS_LTC2990_CACHE
+/* CONTROL and TRIGGER plus the unused register before TINT_MSB */
+#define LTC2990_BLOCK_HEAD	(LTC2990_TINT_MSB - LTC2990_CONTROL)
+
+/*
+ * Read all measurement registers in one transfer. It starts at CONTROL,
+ * so every block refresh also verifies the mode for three extra bytes.
+ */
+static int ltc2990_read_block(struct ltc2990_data *data,
+			      u16 raw[LTC2990_NUM_REGS], int *control)
+{
+	u8 buf[LTC2990_BLOCK_HEAD + LTC2990_BLOCK_LEN];
+	int ret;
+
+	ret = i2c_smbus_read_i2c_block_data(data->i2c, LTC2990_CONTROL,
+					    sizeof(buf), buf);
+	if (unlikely(ret < 0))
+		return ret;
+	if (unlikely(ret != sizeof(buf)))
+		return -EIO;
+
+	*control = buf[0];
+	ltc2990_unpack_block(buf + LTC2990_BLOCK_HEAD, raw);
+	return 0;
+}
+
+/*
+ * Whether another user holds the physical bus right now. Adapter users
+ * queue on the root adapter lock, so a held lock is the only sign of
+ * pending traffic available to a client driver.
+ */
+static bool ltc2990_bus_busy(struct ltc2990_data *data)
+{
+	struct i2c_adapter *adap = data->i2c->adapter;
+
+	if (!i2c_trylock_bus(adap, I2C_LOCK_ROOT_ADAPTER))
+		return true;
+	i2c_unlock_bus(adap, I2C_LOCK_ROOT_ADAPTER);
+	return false;
+}
+
+/*
+ * Read the raw contents of every register used by the current mode. With
+ * LTC2990_UPDATE_YIELD the registers are read with word transfers, each
+ * holding the bus for a few bytes only, and the read is abandoned with
+ * -EBUSY as soon as another user is found on the bus. control is set to
+ * CONTROL if the transfer included it, otherwise left alone.
+ */
+static int ltc2990_read_raw(struct ltc2990_data *data,
+			    u16 raw[LTC2990_NUM_REGS], unsigned int flags,
+			    int *control)
+{
+	unsigned long chans = ltc2990_mode_chans[data->mode];
+	bool yield = flags & LTC2990_UPDATE_YIELD;
+	int ch;
+	int val;
+
+	if (data->xfer == LTC2990_XFER_BLOCK && !yield)
+		return ltc2990_read_block(data, raw, control);
+
+	for_each_set_bit(ch, &chans, LTC2990_NUM_CHANNELS) {
+		u8 reg = ltc2990_chans[ch].reg;
+
+		if (yield && ltc2990_bus_busy(data))
+			return -EBUSY;
+		val = i2c_smbus_read_word_swapped(data->i2c, reg);
+		if (unlikely(val < 0))
+			return val;
+		raw[LTC2990_REG_IDX(reg)] = val;
+	}
+
+	return 0;
+}
+
+/* Registers ltc2990_read_raw() fills, as a bitmap of register indices */
+static u8 ltc2990_raw_mask(struct ltc2990_data *data, unsigned int flags)
+{
+	unsigned long chans = ltc2990_mode_chans[data->mode];
+	u8 mask = 0;
+	int ch;
+
+	if (data->xfer == LTC2990_XFER_BLOCK &&
+	    !(flags & LTC2990_UPDATE_YIELD))
+		return BIT(LTC2990_NUM_REGS) - 1;
+
+	for_each_set_bit(ch, &chans, LTC2990_NUM_CHANNELS)
+		mask |= BIT(LTC2990_REG_IDX(ltc2990_chans[ch].reg));
+
+	return mask;
+}
+
+/*
+ * Convert all channels of the current mode from a raw register snapshot.
+ * The chip clears the data valid flag of a register when it is read, so a
+ * clear flag on a channel that was valid means no conversion completed
+ * since the last refresh and the cached value still stands. Returns the
+ * channels that got a new conversion.
+ */
+static u16 ltc2990_convert_all(struct ltc2990_data *data,
+			       const u16 raw[LTC2990_NUM_REGS])
+{
+	unsigned long chans = ltc2990_mode_chans[data->mode];
+	u16 held = data->valid ? data->data_valid : 0;
+	u16 fresh = 0;
+	int ch;
+
+	for_each_set_bit(ch, &chans, LTC2990_NUM_CHANNELS) {
+		const struct ltc2990_chan *chan = &ltc2990_chans[ch];
+		u16 reg = raw[LTC2990_REG_IDX(chan->reg)];
+		int val = ltc2990_convert(chan, reg);
+
+		if (reg & LTC2990_DATA_VALID) {
+			fresh |= BIT(ch);
+			val = ltc2990_filter(data, ch, val);
+		} else if (held & BIT(ch)) {
+			continue;
+		}
+		data->value[ch] = val;
+		ltc2990_history_update(data, ch, val);
+	}
+
+	data->data_valid = fresh | (held & chans);
+	return fresh;
+}
+
+/*
+ * A chip that lost power comes back with CONTROL cleared, converting only
+ * its die temperature. Block refreshes read CONTROL along with the
+ * measurements; word refreshes read it back once per update_interval,
+ * the age at which cached values are refreshed anyway, so a reset is
+ * found as soon as the cache would show it, and after a bus error. Forced
+ * refreshes in between skip the check. If it does not hold the
+ * configured mode it is rewritten and a conversion triggered. Until that
+ * completes the measurement registers carry no data valid flag, so the
+ * cached values stand in for them. Returns 0 or a bus error.
+ */
+static int ltc2990_check_control(struct ltc2990_data *data, int control)
+{
+	u8 expect = LTC2990_CONTROL_MEASURE_ALL | data->mode;
+	int ret;
+
+	if (control < 0) {
+		if (!data->recheck &&
+		    time_before(jiffies, data->control_checked +
+				data->update_interval))
+			return 0;
+		data->control_checks++;
+		control = i2c_smbus_read_byte_data(data->i2c, LTC2990_CONTROL);
+		if (control < 0)
+			return control;
+	}
+	data->control_checked = jiffies;
+	if (likely(control == expect)) {
+		data->recheck = false;
+		return 0;
+	}
+
+	dev_warn_ratelimited(&data->i2c->dev,
+			     "CONTROL reads 0x%02x, restoring 0x%02x\n",
+			     control, expect);
+	ret = i2c_smbus_write_byte_data(data->i2c, LTC2990_CONTROL, expect);
+	if (!ret)
+		ret = i2c_smbus_write_byte_data(data->i2c, LTC2990_TRIGGER, 1);
+	if (ret)
+		return ret;
+
+	data->recheck = false;
+	data->resets++;
+	data->last_reset = ktime_get_ns();
+	return 0;
+}
+
+/*
+ * Refresh all registers used by the current mode if the cache is stale.
+ * A refresh that yielded the bus leaves the cache as it was and returns
+ * -EBUSY.
+ */
+static int ltc2990_update(struct ltc2990_data *data, unsigned int flags)
+{
+	u16 raw[LTC2990_NUM_REGS] = { 0 };
+	int control = -1;
+	u16 fresh;
+	int ret = 0;
+
+	mutex_lock(&data->update_lock);
+
+	if (!(flags & LTC2990_UPDATE_FORCE) && data->valid &&
+	    time_before(jiffies, data->last_updated + data->update_interval))
+		goto abort;
+
+	ret = ltc2990_read_raw(data, raw, flags, &control);
+	if (ret == -EBUSY)
+		goto abort;
+	if (!ret)
+		ret = ltc2990_check_control(data, control);
+	if (unlikely(ret < 0)) {
+		data->valid = false;
+		data->recheck = true;
+		goto abort;
+	}
+
+	if (trace_ltc2990_raw_enabled())
+		trace_ltc2990_raw(data->i2c, data->mode,
+				  ltc2990_raw_mask(data, flags), raw);
+
+	fresh = ltc2990_convert_all(data, raw);
+	data->timestamp = ktime_get_ns();
+	trace_ltc2990_sample(data->i2c, data->mode, data->data_valid,
+			     data->timestamp, raw, data->value);
+	data->last_updated = jiffies;
+	data->valid = true;
+	ltc2990_cursors_feed(data, fresh);
+
+abort:
+	mutex_unlock(&data->update_lock);
+	return ret;
+}
+
+static int ltc2990_read(struct ltc2990_data *data, int ch, int *value)
+{
+	int ret = 0;
+
+	ret = ltc2990_update(data, 0);
+	if (unlikely(ret < 0))
+		return ret;
+
+	*value = READ_ONCE(data->value[ch]);
+	return 0;
+}
+
+static void ltc2990_cache_init(struct ltc2990_data *data)
+{
+	mutex_init(&data->update_lock);
+	data->control_checked = jiffies;
+	data->update_interval =
+		msecs_to_jiffies(LTC2990_UPDATE_INTERVAL_DEFAULT);
+	ltc2990_history_reset(data);
+}
+
+/* Fastest of LTC2990_PROBE_SAMPLES word reads, or a negative error */
+static s64 ltc2990_time_word(struct ltc2990_data *data)
+{
+	u64 best = U64_MAX;
+	int ret;
+	int i;
+
+	for (i = 0; i < LTC2990_PROBE_SAMPLES; i++) {
+		u64 start = ktime_get_ns();
+
+		ret = i2c_smbus_read_word_swapped(data->i2c, LTC2990_TINT_MSB);
+		if (ret < 0)
+			return ret;
+		best = min(best, ktime_get_ns() - start);
+	}
+
+	return best;
+}
+
+/* Fastest of LTC2990_PROBE_SAMPLES block reads, or a negative error */
+static s64 ltc2990_time_block(struct ltc2990_data *data)
+{
+	u16 raw[LTC2990_NUM_REGS];
+	u64 best = U64_MAX;
+	int control;
+	int ret;
+	int i;
+
+	if (!i2c_check_functionality(data->i2c->adapter,
+				     I2C_FUNC_SMBUS_READ_I2C_BLOCK))
+		return -EOPNOTSUPP;
+
+	for (i = 0; i < LTC2990_PROBE_SAMPLES; i++) {
+		u64 start = ktime_get_ns();
+
+		ret = ltc2990_read_block(data, raw, &control);
+		if (ret < 0)
+			return ret;
+		best = min(best, ktime_get_ns() - start);
+	}
+
+	return best;
+}
+
+/* Pick the transfer that refreshes the current mode fastest */
+static void ltc2990_choose_xfer(struct ltc2990_data *data)
+{
+	u64 word = (u64)data->word_ns *
+		   hweight_long(ltc2990_mode_chans[data->mode]);
+
+	data->refresh_ns = min_t(u64, word, U32_MAX);
+	data->xfer = LTC2990_XFER_WORD;
+
+	if (data->block_ns && data->block_ns < word) {
+		data->refresh_ns = data->block_ns;
+		data->xfer = LTC2990_XFER_BLOCK;
+	}
+}
+
+/*
+ * Start measuring in another mode. Called with update_lock held, so no
+ * refresh can convert registers of one mode with the tables of another.
+ */
+static void ltc2990_cache_set_mode(struct ltc2990_data *data, u8 mode)
+{
+	data->mode = mode;
+	data->valid = false;
+	ltc2990_history_reset(data);
+	ltc2990_filter_reset(data);
+	ltc2990_choose_xfer(data);
+}
+
+static inline void ltc2990_cache_lock(struct ltc2990_data *data)
+{
+	mutex_lock(&data->update_lock);
+}
+
+static inline void ltc2990_cache_unlock(struct ltc2990_data *data)
+{
+	mutex_unlock(&data->update_lock);
+}
+
+/*
+ * Time word and block reads on the actual bus, pick whichever refreshes
+ * the current mode faster and derive the default update interval from
+ * the resulting refresh cost.
+ */
+static int ltc2990_characterize(struct ltc2990_data *data)
+{
+	unsigned int interval;
+	s64 word, block;
+
+	word = ltc2990_time_word(data);
+	if (word < 0)
+		return word;
+	block = ltc2990_time_block(data);
+
+	data->word_ns = min_t(s64, word, U32_MAX);
+	data->block_ns = block < 0 ? 0 : min_t(s64, block, U32_MAX);
+	ltc2990_choose_xfer(data);
+
+	interval = div_u64((u64)data->refresh_ns * LTC2990_BUS_DUTY,
+			   NSEC_PER_MSEC);
+	interval = max_t(unsigned int, interval,
+			 LTC2990_UPDATE_INTERVAL_DEFAULT);
+	data->update_interval = msecs_to_jiffies(interval);
+
+	return 0;
+}
+
+static int ltc2990_bus_show(struct seq_file *s, void *unused)
+{
+	struct ltc2990_data *data = s->private;
+
+	seq_printf(s, "xfer:\t\t%s\n",
+		   data->xfer == LTC2990_XFER_BLOCK ? "block" : "word");
+	seq_printf(s, "word_ns:\t%u\n", data->word_ns);
+	seq_printf(s, "block_ns:\t%u\n", data->block_ns);
+	seq_printf(s, "refresh_ns:\t%u\n", data->refresh_ns);
+	seq_printf(s, "update_interval:\t%u\n",
+		   jiffies_to_msecs(data->update_interval));
+	seq_printf(s, "control_checks:\t%u\n", data->control_checks);
+	seq_printf(s, "resets:\t\t%u\n", data->resets);
+	seq_printf(s, "last_reset_ns:\t%llu\n", data->last_reset);
+
+	return 0;
+}
+
+static int ltc2990_bus_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ltc2990_bus_show, inode->i_private);
+}
+
+static const struct file_operations ltc2990_bus_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ltc2990_bus_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void ltc2990_cache_debugfs_init(struct ltc2990_data *data)
+{
+	debugfs_create_file("bus", S_IRUGO, data->debugfs, data,
+			    &ltc2990_bus_fops);
+}
+#else
+/* Read and convert a single channel */
+static int ltc2990_get_value(struct i2c_client *i2c, int ch, int *result)
+{
+	const struct ltc2990_chan *chan = &ltc2990_chans[ch];
+	int val;
+
+	val = i2c_smbus_read_word_swapped(i2c, chan->reg);
+	if (unlikely(val < 0))
+		return val;
+
+	*result = ltc2990_convert(chan, val);
+	return 0;
+}
+
+static inline int ltc2990_read(struct ltc2990_data *data, int ch, int *value)
+{
+	return ltc2990_get_value(data->i2c, ch, value);
+}
+
+static inline void ltc2990_cache_init(struct ltc2990_data *data) {}
+
+static inline int ltc2990_characterize(struct ltc2990_data *data)
+{
+	return 0;
+}
+
+static inline void ltc2990_cache_debugfs_init(struct ltc2990_data *data) {}
+
+static inline void ltc2990_cache_set_mode(struct ltc2990_data *data, u8 mode)
+{
+	data->mode = mode;
+}
+
+static inline void ltc2990_cache_lock(struct ltc2990_data *data) {}
+static inline void ltc2990_cache_unlock(struct ltc2990_data *data) {}
+#endif
+
+/* Insert after the last device on the same segment, else on the same root */
+static struct list_head *ltc2990_device_pos(struct ltc2990_data *data)
+{
+	struct i2c_adapter *adap = data->i2c->adapter;
+	struct i2c_adapter *root = i2c_root_adapter(&adap->dev);
+	struct list_head *same_root = NULL;
+	struct list_head *same_seg = NULL;
+	struct ltc2990_data *d;
+
+	list_for_each_entry(d, &ltc2990_devices, node) {
+		if (d->i2c->adapter == adap)
+			same_seg = &d->node;
+		if (i2c_root_adapter(&d->i2c->adapter->dev) == root)
+			same_root = &d->node;
+	}
+
+	if (same_seg)
+		return same_seg;
+	if (same_root)
+		return same_root;
+	return ltc2990_devices.prev;
+}
+
+#if defined(CONFIG_SENSORS_LTC2990_CHARDEV) || \
+    defined(CONFIG_SENSORS_LTC2990_NETLINK)
+/* Fill one snapshot from the device cache */
+static void ltc2990_snapshot_fill(struct ltc2990_data *data,
+				  struct ltc2990_snapshot *snap)
+{
+	memset(snap, 0, sizeof(*snap));
+	snap->adapter = i2c_adapter_id(data->i2c->adapter);
+	snap->addr = data->i2c->addr;
+
+	mutex_lock(&data->update_lock);
+	snap->mode = data->mode;
+	if (data->valid) {
+		snap->valid = ltc2990_mode_chans[data->mode] &
+			      data->data_valid;
+		snap->timestamp = data->timestamp;
+		memcpy(snap->value, data->value, sizeof(snap->value));
+	}
+	mutex_unlock(&data->update_lock);
+}
+#endif
+
+#ifdef CONFIG_SENSORS_LTC2990_NETLINK
+/* Snapshots per message, keeps the attribute well below its 64k limit */
+#define LTC2990_GENL_BATCH	128
+
+static const struct genl_multicast_group ltc2990_genl_mcgrps[] = {
+	{ .name = LTC2990_GENL_MCGRP_SAMPLES, },
+};
+
+static struct genl_family ltc2990_genl_family __ro_after_init = {
+	.name		= LTC2990_GENL_NAME,
+	.version	= LTC2990_GENL_VERSION,
+	.maxattr	= LTC2990_ATTR_MAX,
+	.module		= THIS_MODULE,
+	.mcgrps		= ltc2990_genl_mcgrps,
+	.n_mcgrps	= ARRAY_SIZE(ltc2990_genl_mcgrps),
+};
+
+/* Statistics, protected by ltc2990_devices_lock */
+static unsigned long ltc2990_genl_msgs;
+static unsigned long ltc2990_genl_drops;
+
+/* Encode devices [first, first + n) starting at pos into one message */
+static int ltc2990_genl_send(struct ltc2990_data *pos, unsigned int scan,
+			     unsigned int first, unsigned int n)
+{
+	size_t len = n * sizeof(struct ltc2990_snapshot);
+	struct ltc2990_snapshot *snaps;
+	struct ltc2990_data *data = pos;
+	struct sk_buff *skb;
+	struct nlattr *attr;
+	unsigned int i = 0;
+	void *hdr;
+
+	skb = genlmsg_new(3 * nla_total_size(sizeof(u32)) +
+			  nla_total_size_64bit(len), GFP_KERNEL);
+	if (!skb)
+		return -ENOMEM;
+
+	hdr = genlmsg_put(skb, 0, 0, &ltc2990_genl_family, 0,
+			  LTC2990_CMD_SAMPLES);
+	if (!hdr)
+		goto nla_put_failure;
+
+	if (nla_put_u32(skb, LTC2990_ATTR_SCAN, scan) ||
+	    nla_put_u32(skb, LTC2990_ATTR_FIRST, first) ||
+	    nla_put_u32(skb, LTC2990_ATTR_TOTAL, ltc2990_nr_devices))
+		goto nla_put_failure;
+
+	/* the snapshots hold u64 timestamps, keep them naturally aligned */
+	attr = nla_reserve_64bit(skb, LTC2990_ATTR_SNAPSHOTS, len,
+				 LTC2990_ATTR_PAD);
+	if (!attr)
+		goto nla_put_failure;
+
+	/* encode straight into the message, no intermediate copy */
+	snaps = nla_data(attr);
+	list_for_each_entry_from(data, &ltc2990_devices, node) {
+		if (i == n)
+			break;
+		ltc2990_snapshot_fill(data, &snaps[i++]);
+	}
+
+	genlmsg_end(skb, hdr);
+	return genlmsg_multicast(&ltc2990_genl_family, skb, 0, 0, GFP_KERNEL);
+
+nla_put_failure:
+	nlmsg_free(skb);
+	return -EMSGSIZE;
+}
+
+/* Publish the scan just completed to the samples group, if anyone listens */
+static void ltc2990_genl_publish(unsigned int scan)
+{
+	struct ltc2990_data *data;
+	unsigned int i = 0;
+
+	lockdep_assert_held(&ltc2990_devices_lock);
+
+	if (!genl_has_listeners(&ltc2990_genl_family, &init_net, 0))
+		return;
+
+	list_for_each_entry(data, &ltc2990_devices, node) {
+		unsigned int n;
+		int ret;
+
+		if (i++ % LTC2990_GENL_BATCH)
+			continue;
+
+		n = min_t(unsigned int, LTC2990_GENL_BATCH,
+			  ltc2990_nr_devices - (i - 1));
+		ret = ltc2990_genl_send(data, scan, i - 1, n);
+		/* -ESRCH only means the last listener just went away */
+		if (ret && ret != -ESRCH)
+			ltc2990_genl_drops++;
+		else
+			ltc2990_genl_msgs++;
+	}
+}
+
+static int ltc2990_genl_init(void)
+{
+	return genl_register_family(&ltc2990_genl_family);
+}
+
+static void ltc2990_genl_exit(void)
+{
+	genl_unregister_family(&ltc2990_genl_family);
+}
+#else
+static inline void ltc2990_genl_publish(unsigned int scan) {}
+
+static inline int ltc2990_genl_init(void)
+{
+	return 0;
+}
+
+static inline void ltc2990_genl_exit(void) {}
+#endif
+
+#ifdef CONFIG_SENSORS_LTC2990_SAMPLER
+static int sample_interval = -1;
+module_param(sample_interval, int, S_IRUGO);
+MODULE_PARM_DESC(sample_interval,
+		 "Background sampling interval in ms, 0 to disable, -1 to derive from the measured bus cost (default)");
+
+static bool lowprio;
+module_param(lowprio, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(lowprio,
+		 "Sampler refreshes give way to other users of the bus");
+
+static unsigned int bus_budget_us;
+module_param(bus_budget_us, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(bus_budget_us,
+		 "Bus time the sampler may use per bus_window_ms, 0 for no limit (default)");
+
+static unsigned int bus_window_ms = 1000;
+module_param(bus_window_ms, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(bus_window_ms, "Window of bus_budget_us in ms");
+
+/* Yielded refreshes in a row after which a device is refreshed anyway */
+#define LTC2990_YIELD_MAX	4
+
+/* Statistics, protected by ltc2990_devices_lock */
+static unsigned long ltc2990_scans;
+static unsigned int ltc2990_scan_interval;	/* ms */
+static unsigned int ltc2990_mux_switches;	/* per scan, grouped */
+static unsigned int ltc2990_mux_switches_probe;	/* per scan, probe order */
+static unsigned long ltc2990_deferrals;
+static unsigned long ltc2990_throttles;
+
+/* Bus time accounting, also protected by ltc2990_devices_lock */
+static unsigned int ltc2990_scan_pos;	/* where a throttled scan resumes */
+static unsigned long ltc2990_window_start;	/* in jiffies */
+static u64 ltc2990_window_ns;		/* sampler bus time in the window */
+
+static void ltc2990_sample_work_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(ltc2990_sample_work, ltc2990_sample_work_fn);
+
+/*
+ * Refresh one device for the sampler and return the time it took. With
+ * lowprio a device whose refresh keeps yielding is refreshed regardless
+ * after LTC2990_YIELD_MAX scans, so a busy bus cannot starve it. Called
+ * without ltc2990_devices_lock, so other devices' users are not held up
+ * by this one's bus time.
+ */
+static u64 ltc2990_sample_one(struct ltc2990_data *data)
+{
+	unsigned int flags = LTC2990_UPDATE_FORCE;
+	u64 start = ktime_get_ns();
+
+	if (READ_ONCE(lowprio) && data->deferred < LTC2990_YIELD_MAX)
+		flags |= LTC2990_UPDATE_YIELD;
+
+	if (ltc2990_update(data, flags) == -EBUSY)
+		data->deferred++;
 	else
-		return (raw & 0x3FFF) << 2;
+		data->deferred = 0;
+
+	return ktime_get_ns() - start;
+}
+
+/* Position of a listed device */
+static unsigned int ltc2990_scan_index(struct ltc2990_data *data)
+{
+	struct ltc2990_data *d;
+	unsigned int pos = 0;
+
+	list_for_each_entry(d, &ltc2990_devices, node) {
+		if (d == data)
+			break;
+		pos++;
+	}
+
+	return pos;
+}
+
+/* Device at position pos of the list, or NULL past its end */
+static struct ltc2990_data *ltc2990_scan_seek(unsigned int pos)
+{
+	struct ltc2990_data *data;
+
+	list_for_each_entry(data, &ltc2990_devices, node)
+		if (!pos--)
+			return data;
+
+	return NULL;
+}
+
+/*
+ * Scan all devices. Once the sampler used up bus_budget_us of the current
+ * window the scan stops and resumes with the next device when the window
+ * ends; every window refreshes at least one device.
+ *
+ * ltc2990_devices_lock is dropped around each refresh, with a reference
+ * keeping the device from being freed. ltc2990_scan_pos always indexes
+ * the next device to refresh; ltc2990_sampler_remove() adjusts it when a
+ * device before it leaves the list meanwhile.
+ */
+static void ltc2990_sample_work_fn(struct work_struct *work)
+{
+	unsigned long window = msecs_to_jiffies(max(READ_ONCE(bus_window_ms),
+						    1u));
+	u64 budget_ns = (u64)READ_ONCE(bus_budget_us) * NSEC_PER_USEC;
+	unsigned int interval = sample_interval;
+	struct ltc2990_data *data, *next;
+	bool throttled = false;
+	unsigned long delay;
+	u64 scan_ns = 0;
+	u64 ns;
+
+	mutex_lock(&ltc2990_devices_lock);
+	if (!ltc2990_window_ns ||
+	    time_after_eq(jiffies, ltc2990_window_start + window)) {
+		ltc2990_window_start = jiffies;
+		ltc2990_window_ns = 0;
+	}
+
+	list_for_each_entry(data, &ltc2990_devices, node)
+		scan_ns += data->refresh_ns;
+
+	data = ltc2990_scan_seek(ltc2990_scan_pos);
+	while (data) {
+		if (budget_ns && ltc2990_window_ns >= budget_ns) {
+			throttled = true;
+			break;
+		}
+
+		ltc2990_device_get(data);
+		ltc2990_scan_pos++;
+		mutex_unlock(&ltc2990_devices_lock);
+		ns = ltc2990_sample_one(data);
+		mutex_lock(&ltc2990_devices_lock);
+
+		ltc2990_window_ns += ns;
+		if (data->deferred)
+			ltc2990_deferrals++;
+		/* removed meanwhile, its successor is found by position */
+		if (list_empty(&data->node))
+			next = ltc2990_scan_seek(ltc2990_scan_pos);
+		else if (list_is_last(&data->node, &ltc2990_devices))
+			next = NULL;
+		else
+			next = list_next_entry(data, node);
+		ltc2990_device_put(data);
+		data = next;
+	}
+
+	/* keep a full scan of all devices within the bus duty budget */
+	if (sample_interval < 0)
+		interval = max_t(unsigned int,
+				 div_u64(scan_ns * LTC2990_BUS_DUTY,
+					 NSEC_PER_MSEC),
+				 LTC2990_UPDATE_INTERVAL_DEFAULT);
+
+	if (throttled) {
+		ltc2990_throttles++;
+		delay = ltc2990_window_start + window - jiffies;
+		if ((long)delay < 0)
+			delay = 0;
+	} else {
+		ltc2990_scan_pos = 0;
+		ltc2990_scans++;
+		ltc2990_scan_interval = interval;
+		trace_ltc2990_scan(ltc2990_scans, ltc2990_nr_devices,
+				   interval);
+		ltc2990_genl_publish(ltc2990_scans);
+		delay = msecs_to_jiffies(interval);
+	}
+
+	if (!list_empty(&ltc2990_devices))
+		queue_delayed_work(system_power_efficient_wq,
+				   &ltc2990_sample_work, delay);
+	mutex_unlock(&ltc2990_devices_lock);
+}
+
+static inline bool ltc2990_behind_mux(struct i2c_adapter *adap)
+{
+	return i2c_parent_is_i2c_adapter(adap) != NULL;
+}
+
+/*
+ * Number of mux channel selections needed to read the devices in the
+ * given order, assuming the mux keeps its last channel selected.
+ */
+static unsigned int ltc2990_count_switches(struct ltc2990_data **order,
+					   unsigned int n)
+{
+	unsigned int switches = 0;
+	int i, j;
+
+	for (i = 0; i < n; i++) {
+		struct i2c_adapter *adap = order[i]->i2c->adapter;
+		struct i2c_adapter *root;
+
+		if (!ltc2990_behind_mux(adap))
+			continue;
+		root = i2c_root_adapter(&adap->dev);
+
+		/* previous device behind a mux on the same root */
+		for (j = i - 1; j >= 0; j--) {
+			struct i2c_adapter *prev = order[j]->i2c->adapter;
+
+			if (ltc2990_behind_mux(prev) &&
+			    i2c_root_adapter(&prev->dev) == root)
+				break;
+		}
+		if (j < 0 || order[j]->i2c->adapter != adap)
+			switches++;
+	}
+
+	return switches;
+}
+
+static int ltc2990_cmp_seq(const void *a, const void *b)
+{
+	const struct ltc2990_data *x = *(struct ltc2990_data * const *)a;
+	const struct ltc2990_data *y = *(struct ltc2990_data * const *)b;
+
+	return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+/* Recompute the switch statistics after the device list changed */
+static void ltc2990_sampler_recount(void)
+{
+	struct ltc2990_data **order;
+	struct ltc2990_data *data;
+	unsigned int n = 0;
+
+	lockdep_assert_held(&ltc2990_devices_lock);
+
+	ltc2990_mux_switches = 0;
+	ltc2990_mux_switches_probe = 0;
+	if (!ltc2990_nr_devices)
+		return;
+
+	order = kmalloc_array(ltc2990_nr_devices, sizeof(*order), GFP_KERNEL);
+	if (!order)
+		return;
+
+	list_for_each_entry(data, &ltc2990_devices, node)
+		order[n++] = data;
+	ltc2990_mux_switches = ltc2990_count_switches(order, n);
+
+	sort(order, n, sizeof(*order), ltc2990_cmp_seq, NULL);
+	ltc2990_mux_switches_probe = ltc2990_count_switches(order, n);
+
+	kfree(order);
+}
+
+/*
+ * Devices joining or leaving the list, called with ltc2990_devices_lock
+ * held while data is on it. ltc2990_scan_pos is kept on the same device,
+ * so a throttled or interrupted scan neither skips nor repeats one.
+ */
+static void ltc2990_sampler_add(struct ltc2990_data *data)
+{
+	if (ltc2990_scan_index(data) < ltc2990_scan_pos)
+		ltc2990_scan_pos++;
+}
+
+static void ltc2990_sampler_remove(struct ltc2990_data *data)
+{
+	if (ltc2990_scan_index(data) < ltc2990_scan_pos)
+		ltc2990_scan_pos--;
+}
+
+static void ltc2990_sampler_start(void)
+{
+	if (sample_interval)
+		queue_delayed_work(system_power_efficient_wq,
+				   &ltc2990_sample_work, 0);
+}
+
+static void ltc2990_sampler_exit(void)
+{
+	cancel_delayed_work_sync(&ltc2990_sample_work);
+}
+
+static int ltc2990_sampler_show(struct seq_file *s, void *unused)
+{
+	mutex_lock(&ltc2990_devices_lock);
+	seq_printf(s, "devices:\t\t%u\n", ltc2990_nr_devices);
+	seq_printf(s, "scans:\t\t\t%lu\n", ltc2990_scans);
+	seq_printf(s, "interval_ms:\t\t%u\n", ltc2990_scan_interval);
+	seq_printf(s, "mux_switches:\t\t%u\n", ltc2990_mux_switches);
+	seq_printf(s, "mux_switches_probe:\t%u\n",
+		   ltc2990_mux_switches_probe);
+	seq_printf(s, "deferrals:\t\t%lu\n", ltc2990_deferrals);
+	seq_printf(s, "throttles:\t\t%lu\n", ltc2990_throttles);
+	seq_printf(s, "window_us:\t\t%llu\n",
+		   div_u64(ltc2990_window_ns, NSEC_PER_USEC));
+#ifdef CONFIG_SENSORS_LTC2990_NETLINK
+	seq_printf(s, "netlink_msgs:\t\t%lu\n", ltc2990_genl_msgs);
+	seq_printf(s, "netlink_drops:\t\t%lu\n", ltc2990_genl_drops);
+#endif
+	mutex_unlock(&ltc2990_devices_lock);
+
+	return 0;
+}
+
+static int ltc2990_sampler_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ltc2990_sampler_show, NULL);
+}
+
+static const struct file_operations ltc2990_sampler_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ltc2990_sampler_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void ltc2990_sampler_debugfs_init(void)
+{
+	debugfs_create_file("sampler", S_IRUGO, ltc2990_debugfs_root, NULL,
+			    &ltc2990_sampler_fops);
+}
+#else
+static inline void ltc2990_sampler_recount(void) {}
+static inline void ltc2990_sampler_add(struct ltc2990_data *data) {}
+static inline void ltc2990_sampler_remove(struct ltc2990_data *data) {}
+static inline void ltc2990_sampler_start(void) {}
+static inline void ltc2990_sampler_exit(void) {}
+static inline void ltc2990_sampler_debugfs_init(void) {}
+#endif
+
+static void ltc2990_device_remove(void *arg)
+{
+	struct ltc2990_data *data = arg;
+
+	mutex_lock(&ltc2990_devices_lock);
+	ltc2990_sampler_remove(data);
+	list_del_init(&data->node);
+	ltc2990_cursors_del(data);
+	ltc2990_nr_devices--;
+	ltc2990_sampler_recount();
+	mutex_unlock(&ltc2990_devices_lock);
+
+	/* wait for users that took the device off the list */
+	ltc2990_device_put(data);
+	wait_for_completion(&data->released);
+}
+
+static int ltc2990_device_add(struct ltc2990_data *data)
+{
+	int ret;
+
+	mutex_lock(&ltc2990_devices_lock);
+	ret = ltc2990_cursors_add(data);
+	if (ret) {
+		mutex_unlock(&ltc2990_devices_lock);
+		return ret;
+	}
+	data->seq = ltc2990_probe_seq++;
+	kref_init(&data->ref);
+	init_completion(&data->released);
+	list_add(&data->node, ltc2990_device_pos(data));
+	ltc2990_sampler_add(data);
+	ltc2990_nr_devices++;
+	ltc2990_sampler_recount();
+	ltc2990_sampler_start();
+	mutex_unlock(&ltc2990_devices_lock);
+
+	return devm_add_action_or_reset(&data->i2c->dev,
+					ltc2990_device_remove, data);
+}
+
+#ifdef CONFIG_SENSORS_LTC2990_CHARDEV
+static long ltc2990_ioctl_snapshot(void __user *argp)
+{
+	struct ltc2990_snapshot_req req;
+	struct ltc2990_snapshot *snaps = NULL;
+	struct ltc2990_data **devs = NULL;
+	struct ltc2990_data *data;
+	unsigned int n = 0, i;
+	long ret = 0;
+
+	/* the uapi channel numbering is the driver's channel table order */
+	BUILD_BUG_ON((int)LTC2990_NUM_CHANNELS != LTC2990_CHAN_COUNT);
+	BUILD_BUG_ON((int)LTC2990_CURR1 != LTC2990_CHAN_CURR1);
+	BUILD_BUG_ON((int)LTC2990_IN4 != LTC2990_CHAN_IN4);
+
+	if (copy_from_user(&req, argp, sizeof(req)))
+		return -EFAULT;
+
+	mutex_lock(&ltc2990_devices_lock);
+	req.total = ltc2990_nr_devices;
+	req.count = min(req.count, req.total);
+	if (req.count) {
+		snaps = kmalloc_array(req.count, sizeof(*snaps), GFP_KERNEL);
+		devs = kmalloc_array(req.count, sizeof(*devs), GFP_KERNEL);
+		if (!snaps || !devs) {
+			mutex_unlock(&ltc2990_devices_lock);
+			kfree(snaps);
+			kfree(devs);
+			return -ENOMEM;
+		}
+	}
+	list_for_each_entry(data, &ltc2990_devices, node) {
+		if (n == req.count)
+			break;
+		ltc2990_device_get(data);
+		devs[n++] = data;
+	}
+	mutex_unlock(&ltc2990_devices_lock);
+
+	/* stale caches are refreshed without holding up other devices */
+	for (i = 0; i < n; i++) {
+		ltc2990_update(devs[i], 0);
+		ltc2990_snapshot_fill(devs[i], &snaps[i]);
+		ltc2990_device_put(devs[i]);
+	}
+	kfree(devs);
+
+	if (n && copy_to_user(u64_to_user_ptr(req.snapshots), snaps,
+			      n * sizeof(*snaps)))
+		ret = -EFAULT;
+	kfree(snaps);
+
+	req.count = n;
+	if (!ret && copy_to_user(argp, &req, sizeof(req)))
+		ret = -EFAULT;
+
+	return ret;
+}
+
+static int ltc2990_ctl_release(struct inode *inode, struct file *file)
+{
+	struct ltc2990_handle *h = file->private_data;
+	struct ltc2990_cursor *c, *tmp;
+
+	mutex_lock(&ltc2990_devices_lock);
+	list_for_each_entry_safe(c, tmp, &h->cursors, handle_node)
+		ltc2990_cursor_free(c);
+	if (!list_empty(&h->node))
+		list_del(&h->node);
+	mutex_unlock(&ltc2990_devices_lock);
+	kfree(h);
+
+	return 0;
+}
+
+static int ltc2990_ctl_open(struct inode *inode, struct file *file)
+{
+	struct ltc2990_data *data;
+	struct ltc2990_handle *h;
+	int ret = 0;
+
+	h = kzalloc(sizeof(*h), GFP_KERNEL);
+	if (!h)
+		return -ENOMEM;
+	INIT_LIST_HEAD(&h->node);
+	INIT_LIST_HEAD(&h->cursors);
+
+	mutex_lock(&ltc2990_devices_lock);
+	list_for_each_entry(data, &ltc2990_devices, node) {
+		ret = ltc2990_cursor_add(h, data);
+		if (ret)
+			break;
+	}
+	if (!ret)
+		list_add(&h->node, &ltc2990_handles);
+	mutex_unlock(&ltc2990_devices_lock);
+
+	file->private_data = h;
+	if (ret) {
+		ltc2990_ctl_release(inode, file);
+		return ret;
+	}
+
+	return nonseekable_open(inode, file);
+}
+
+/* Report the cursor and restart it, called with update_lock held */
+static void ltc2990_cursor_take(struct ltc2990_cursor *c,
+				struct ltc2990_interval *iv)
+{
+	struct ltc2990_data *data = c->data;
+	int ch;
+
+	memset(iv, 0, sizeof(*iv));
+	iv->adapter = i2c_adapter_id(data->i2c->adapter);
+	iv->addr = data->i2c->addr;
+	iv->mode = data->mode;
+	iv->refreshes = c->refreshes;
+	iv->t_first = c->t_first;
+	iv->t_last = c->t_last;
+	for (ch = 0; ch < LTC2990_NUM_CHANNELS; ch++) {
+		if (!c->count[ch])
+			continue;
+		iv->valid |= BIT(ch);
+		iv->count[ch] = c->count[ch];
+		iv->min[ch] = c->min[ch];
+		iv->max[ch] = c->max[ch];
+		iv->mean[ch] = div_s64(c->sum[ch], c->count[ch]);
+	}
+
+	c->refreshes = 0;
+	memset(c->count, 0, sizeof(c->count));
+	memset(c->sum, 0, sizeof(c->sum));
+}
+
+/*
+ * Return one struct ltc2990_interval per device, as many as fit, covering
+ * the refreshes since this handle's previous read. Devices that did not
+ * fit keep accumulating for the next read.
+ */
+static ssize_t ltc2990_ctl_read(struct file *file, char __user *ubuf,
+				size_t count, loff_t *ppos)
+{
+	struct ltc2990_handle *h = file->private_data;
+	struct ltc2990_interval *iv;
+	struct ltc2990_cursor *c;
+	unsigned int n = 0, i, max;
+	ssize_t ret;
+
+	max = min_t(size_t, count / sizeof(*iv), UINT_MAX);
+	if (!max)
+		return -EINVAL;
+
+	mutex_lock(&ltc2990_devices_lock);
+	max = min(max, h->nr_cursors);
+	if (!max) {
+		mutex_unlock(&ltc2990_devices_lock);
+		return 0;
+	}
+	iv = kmalloc_array(max, sizeof(*iv), GFP_KERNEL);
+	if (!iv) {
+		mutex_unlock(&ltc2990_devices_lock);
+		return -ENOMEM;
+	}
+	list_for_each_entry(c, &h->cursors, handle_node) {
+		if (n == max)
+			break;
+		mutex_lock(&c->data->update_lock);
+		ltc2990_cursor_take(c, &iv[n++]);
+		mutex_unlock(&c->data->update_lock);
+	}
+	/* the devices that did not fit go first next time */
+	for (i = 0; i < n; i++)
+		list_move_tail(h->cursors.next, &h->cursors);
+	mutex_unlock(&ltc2990_devices_lock);
+
+	ret = n * sizeof(*iv);
+	if (copy_to_user(ubuf, iv, ret))
+		ret = -EFAULT;
+	kfree(iv);
+
+	return ret;
+}
+
+static long ltc2990_ctl_ioctl(struct file *file, unsigned int cmd,
+			      unsigned long arg)
+{
+	switch (cmd) {
+	case LTC2990_IOC_SNAPSHOT:
+		return ltc2990_ioctl_snapshot((void __user *)arg);
+	default:
+		return -ENOTTY;
+	}
+}
+
+#ifdef CONFIG_COMPAT
+/* The request layout is the same for 32-bit callers, only arg differs */
+static long ltc2990_ctl_compat_ioctl(struct file *file, unsigned int cmd,
+				     unsigned long arg)
+{
+	return ltc2990_ctl_ioctl(file, cmd, (unsigned long)compat_ptr(arg));
+}
+#endif
+
+static const struct file_operations ltc2990_ctl_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ltc2990_ctl_open,
+	.release	= ltc2990_ctl_release,
+	.read		= ltc2990_ctl_read,
+	.unlocked_ioctl	= ltc2990_ctl_ioctl,
+#ifdef CONFIG_COMPAT
+	.compat_ioctl	= ltc2990_ctl_compat_ioctl,
+#endif
+	.llseek		= no_llseek,
+};
+
+static struct miscdevice ltc2990_ctl = {
+	.minor	= MISC_DYNAMIC_MINOR,
+	.name	= "ltc2990",
+	.fops	= &ltc2990_ctl_fops,
+};
+
+static int ltc2990_ctl_init(void)
+{
+	return misc_register(&ltc2990_ctl);
+}
+
+static void ltc2990_ctl_exit(void)
+{
+	misc_deregister(&ltc2990_ctl);
+}
+#else
+static inline int ltc2990_ctl_init(void)
+{
+	return 0;
+}
+
+static inline void ltc2990_ctl_exit(void) {}
+#endif
+
+/* Slow path, only reached when instrumentation is enabled */
+static noinline void ltc2990_instr_record(struct ltc2990_data *data,
+					  u64 start, int ret)
+{
+	struct ltc2990_instr *instr = &data->instr;
+	u64 now = ktime_get_ns();
+	u64 delta = now - start;
+	u64 max;
+
+	atomic_long_inc(&instr->reads);
+	atomic64_add(delta, &instr->total_ns);
+	atomic64_set(&instr->last_ns, now);
+	atomic_inc(&instr->hist[min_t(int, fls64(delta),
+				      LTC2990_INSTR_BUCKETS - 1)]);
+
+	max = atomic64_read(&instr->max_ns);
+	while (delta > max) {
+		u64 old = atomic64_cmpxchg(&instr->max_ns, max, delta);
+
+		if (old == max)
+			break;
+		max = old;
+	}
+
+	if (ret < 0) {
+		atomic_long_inc(&instr->errors);
+		atomic64_set(&instr->last_err_ns, now);
+	}
+}
+
+static ssize_t ltc2990_show_value(struct device *dev,
+				  struct device_attribute *da, char *buf)
+{
+	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
+	struct ltc2990_data *data = dev_get_drvdata(dev);
+	int value;
+	int ret;
+
+	/* the attribute may be on its way out after a mode switch */
+	if (unlikely(!ltc2990_chan_active(data, attr->index)))
+		return -ENODATA;
+
+	/* one branch, so a read never sees the key flip halfway */
+	if (static_branch_unlikely(&ltc2990_instr_key)) {
+		u64 start = ktime_get_ns();
+
+		ret = ltc2990_read(data, attr->index, &value);
+		ltc2990_instr_record(data, start, ret);
+	} else {
+		ret = ltc2990_read(data, attr->index, &value);
+	}
+
+	if (unlikely(ret < 0))
+		return ret;
+
+	return snprintf(buf, PAGE_SIZE, "%d\n", value);
 }
 
-/* Return the converted value from the given register in uV or mC */
-static int ltc2990_get_value(struct i2c_client *i2c, u8 reg, int *result)
+#define LTC2990_INPUT_ATTR(_id, _name, _index, _reg, _conv)		\
+	static SENSOR_DEVICE_ATTR(_name##_input, S_IRUGO,		\
+				  ltc2990_show_value, NULL, LTC2990_##_id);
+LTC2990_CHANNELS(LTC2990_INPUT_ATTR)
+
+#define LTC2990_INPUT_ATTR_REF(_id, _name, _index, _reg, _conv)	\
+	&sensor_dev_attr_##_name##_input.dev_attr.attr,
+
+static struct attribute *ltc2990_attrs[] = {
+	LTC2990_CHANNELS(LTC2990_INPUT_ATTR_REF)
+	NULL,
+};
+
+/* Only show the attributes of channels measured in the current mode */
+static umode_t ltc2990_attr_visible(struct kobject *kobj,
+				    struct attribute *a, int n)
 {
-	int val;
+	struct device *dev = container_of(kobj, struct device, kobj);
+	struct ltc2990_data *data = dev_get_drvdata(dev);
+	struct device_attribute *da;
 
-	val = i2c_smbus_read_word_swapped(i2c, reg);
-	if (unlikely(val < 0))
-		return val;
+	da = container_of(a, struct device_attribute, attr);
+	if (!ltc2990_chan_active(data, to_sensor_dev_attr(da)->index))
+		return 0;
 
-	switch (reg) {
-	case LTC2990_TINT_MSB:
-		/* internal temp, 0.0625 degrees/LSB, 13-bit  */
-		val = (val & 0x1FFF) << 3;
-		*result = (val * 1000) >> 7;
-		break;
-	case LTC2990_V1_MSB:
-	case LTC2990_V3_MSB:
-		 /* Vx-Vy, 19.42uV/LSB. Depends on mode. */
-		*result = ltc2990_voltage_to_int(val) * 1942 / (4 * 100);
-		break;
-	case LTC2990_VCC_MSB:
-		/* Vcc, 305.18μV/LSB, 2.5V offset */
-		*result = (ltc2990_voltage_to_int(val) * 30518 /
-			   (4 * 100 * 1000)) + 2500;
-		break;
-	default:
-		return -EINVAL; /* won't happen, keep compiler happy */
-	}
+	return a->mode;
+}
 
-	return 0;
+static const struct attribute_group ltc2990_group = {
+	.attrs = ltc2990_attrs,
+	.is_visible = ltc2990_attr_visible,
+};
+
+#ifdef CONFIG_SENSORS_LTC2990_CACHE
+static ssize_t ltc2990_show_update_interval(struct device *dev,
+					    struct device_attribute *da,
+					    char *buf)
+{
+	struct ltc2990_data *data = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%u\n",
+			jiffies_to_msecs(data->update_interval));
 }
 
-static ssize_t ltc2990_show_value(struct device *dev,
-				  struct device_attribute *da, char *buf)
+static ssize_t ltc2990_set_update_interval(struct device *dev,
+					   struct device_attribute *da,
+					   const char *buf, size_t count)
 {
-	struct sensor_device_attribute *attr = to_sensor_dev_attr(da);
+	struct ltc2990_data *data = dev_get_drvdata(dev);
+	unsigned long val;
+	int ret = 0;
+
+	ret = kstrtoul(buf, 10, &val);
+	if (ret)
+		return ret;
+
+	val = max_t(unsigned long, val, LTC2990_UPDATE_INTERVAL_MIN);
+
+	mutex_lock(&data->update_lock);
+	data->update_interval = msecs_to_jiffies(val);
+	mutex_unlock(&data->update_lock);
+
+	return count;
+}
+
+static DEVICE_ATTR(update_interval, S_IRUGO | S_IWUSR,
+		   ltc2990_show_update_interval, ltc2990_set_update_interval);
+
+static struct attribute *ltc2990_cache_attrs[] = {
+	&dev_attr_update_interval.attr,
+	NULL,
+};
+
+static const struct attribute_group ltc2990_cache_group = {
+	.attrs = ltc2990_cache_attrs,
+};
+#endif
+
+#ifdef CONFIG_SENSORS_LTC2990_HISTORY
+static ssize_t ltc2990_show_history(struct device *dev, int ch, char *buf,
+				    bool highest)
+{
+	struct ltc2990_data *data = dev_get_drvdata(dev);
 	int value;
 	int ret;
 
-	ret = ltc2990_get_value(dev_get_drvdata(dev), attr->index, &value);
+	if (unlikely(!ltc2990_chan_active(data, ch)))
+		return -ENODATA;
+
+	ret = ltc2990_update(data, 0);
 	if (unlikely(ret < 0))
 		return ret;
 
+	mutex_lock(&data->update_lock);
+	value = highest ? data->highest[ch] : data->lowest[ch];
+	mutex_unlock(&data->update_lock);
+
 	return snprintf(buf, PAGE_SIZE, "%d\n", value);
 }
 
-static SENSOR_DEVICE_ATTR(temp1_input, S_IRUGO, ltc2990_show_value, NULL,
-			  LTC2990_TINT_MSB);
-static SENSOR_DEVICE_ATTR(curr1_input, S_IRUGO, ltc2990_show_value, NULL,
-			  LTC2990_V1_MSB);
-static SENSOR_DEVICE_ATTR(curr2_input, S_IRUGO, ltc2990_show_value, NULL,
-			  LTC2990_V3_MSB);
-static SENSOR_DEVICE_ATTR(in0_input, S_IRUGO, ltc2990_show_value, NULL,
-			  LTC2990_VCC_MSB);
+static ssize_t ltc2990_show_lowest(struct device *dev,
+				   struct device_attribute *da, char *buf)
+{
+	return ltc2990_show_history(dev, to_sensor_dev_attr(da)->index, buf,
+				    false);
+}
+
+static ssize_t ltc2990_show_highest(struct device *dev,
+				    struct device_attribute *da, char *buf)
+{
+	return ltc2990_show_history(dev, to_sensor_dev_attr(da)->index, buf,
+				    true);
+}
+
+static ssize_t ltc2990_reset_history(struct device *dev,
+				     struct device_attribute *da,
+				     const char *buf, size_t count)
+{
+	struct ltc2990_data *data = dev_get_drvdata(dev);
+
+	mutex_lock(&data->update_lock);
+	ltc2990_history_reset(data);
+	mutex_unlock(&data->update_lock);
 
-static struct attribute *ltc2990_attrs[] = {
-	&sensor_dev_attr_temp1_input.dev_attr.attr,
-	&sensor_dev_attr_curr1_input.dev_attr.attr,
-	&sensor_dev_attr_curr2_input.dev_attr.attr,
-	&sensor_dev_attr_in0_input.dev_attr.attr,
+	return count;
+}
+
+#define LTC2990_HISTORY_ATTRS(_id, _name, _index, _reg, _conv)		\
+	static SENSOR_DEVICE_ATTR(_name##_lowest, S_IRUGO,		\
+				  ltc2990_show_lowest, NULL, LTC2990_##_id); \
+	static SENSOR_DEVICE_ATTR(_name##_highest, S_IRUGO,		\
+				  ltc2990_show_highest, NULL, LTC2990_##_id);
+LTC2990_CHANNELS(LTC2990_HISTORY_ATTRS)
+
+static DEVICE_ATTR(reset_history, S_IWUSR, NULL, ltc2990_reset_history);
+
+#define LTC2990_HISTORY_ATTR_REFS(_id, _name, _index, _reg, _conv)	\
+	&sensor_dev_attr_##_name##_lowest.dev_attr.attr,		\
+	&sensor_dev_attr_##_name##_highest.dev_attr.attr,
+
+static struct attribute *ltc2990_history_attrs[] = {
+	LTC2990_CHANNELS(LTC2990_HISTORY_ATTR_REFS)
+	&dev_attr_reset_history.attr,
+	NULL,
+};
+
+static umode_t ltc2990_history_visible(struct kobject *kobj,
+				       struct attribute *a, int n)
+{
+	if (a == &dev_attr_reset_history.attr)
+		return a->mode;
+
+	return ltc2990_attr_visible(kobj, a, n);
+}
+
+static const struct attribute_group ltc2990_history_group = {
+	.attrs = ltc2990_history_attrs,
+	.is_visible = ltc2990_history_visible,
+};
+#endif
+
+/*
+ * Switch the chip and the cache to mode. If the trigger fails CONTROL is
+ * set back, as far as the bus allows, and the driver keeps the old mode.
+ */
+static int ltc2990_write_mode(struct ltc2990_data *data, u8 mode)
+{
+	int ret;
+
+	ltc2990_cache_lock(data);
+	ret = i2c_smbus_write_byte_data(data->i2c, LTC2990_CONTROL,
+					LTC2990_CONTROL_MEASURE_ALL | mode);
+	if (!ret) {
+		ret = i2c_smbus_write_byte_data(data->i2c, LTC2990_TRIGGER, 1);
+		if (ret)
+			i2c_smbus_write_byte_data(data->i2c, LTC2990_CONTROL,
+						  LTC2990_CONTROL_MEASURE_ALL |
+						  data->mode);
+	}
+	if (!ret)
+		ltc2990_cache_set_mode(data, mode);
+	ltc2990_cache_unlock(data);
+
+	return ret;
+}
+
+/* Show the attributes of the current mode and hide the others */
+static int ltc2990_update_groups(struct ltc2990_data *data)
+{
+	int ret;
+
+	ret = sysfs_update_group(&data->hwmon_dev->kobj, &ltc2990_group);
+#ifdef CONFIG_SENSORS_LTC2990_HISTORY
+	if (!ret)
+		ret = sysfs_update_group(&data->hwmon_dev->kobj,
+					 &ltc2990_history_group);
+#endif
+
+	return ret;
+}
+
+/*
+ * Switch the measurement mode at runtime. Holding the device list lock
+ * keeps snapshot readers and other switches out for the whole switch, the
+ * update lock keeps refreshes out while CONTROL is rewritten. Attributes
+ * of channels the new mode does not measure are removed before the lock
+ * is dropped; if that fails the old mode is restored.
+ */
+static int ltc2990_set_mode(struct ltc2990_data *data, u8 mode)
+{
+	u64 start = ktime_get_ns();
+	u32 delta;
+	int ret = 0;
+	u8 old;
+
+	mutex_lock(&ltc2990_devices_lock);
+	old = data->mode;
+	if (mode == old)
+		goto unlock;
+	/* written through the attribute before probe has recorded it */
+	if (!data->hwmon_dev) {
+		ret = -EAGAIN;
+		goto unlock;
+	}
+
+	ret = ltc2990_write_mode(data, mode);
+	if (ret)
+		goto unlock;
+
+	/* the attributes must match the mode, so go back if they cannot */
+	ret = ltc2990_update_groups(data);
+	if (ret) {
+		if (ltc2990_write_mode(data, old) ||
+		    ltc2990_update_groups(data))
+			dev_err(&data->i2c->dev,
+				"failed to restore mode %u\n", old);
+		goto unlock;
+	}
+
+	delta = min_t(u64, ktime_get_ns() - start, U32_MAX);
+	data->mode_switches++;
+	data->mode_switch_ns = delta;
+	data->mode_switch_max_ns = max(data->mode_switch_max_ns, delta);
+
+unlock:
+	mutex_unlock(&ltc2990_devices_lock);
+	return ret;
+}
+
+static ssize_t ltc2990_store_mode(struct ltc2990_data *data, const char *buf,
+				  size_t count)
+{
+	u8 mode;
+	int ret;
+
+	ret = kstrtou8(buf, 10, &mode);
+	if (ret)
+		return ret;
+	if (mode >= LTC2990_NUM_MODES)
+		return -EINVAL;
+
+	ret = ltc2990_set_mode(data, mode);
+	if (ret)
+		return ret;
+
+	return count;
+}
+
+static ssize_t ltc2990_show_mode(struct device *dev,
+				 struct device_attribute *da, char *buf)
+{
+	struct ltc2990_data *data = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%u\n", READ_ONCE(data->mode));
+}
+
+static ssize_t ltc2990_set_mode_attr(struct device *dev,
+				     struct device_attribute *da,
+				     const char *buf, size_t count)
+{
+	return ltc2990_store_mode(dev_get_drvdata(dev), buf, count);
+}
+
+static DEVICE_ATTR(mode, S_IRUGO | S_IWUSR, ltc2990_show_mode,
+		   ltc2990_set_mode_attr);
+
+static struct attribute *ltc2990_mode_attrs[] = {
+	&dev_attr_mode.attr,
+	NULL,
+};
+
+/* Kept apart from the groups ltc2990_set_mode() updates from this attr */
+static const struct attribute_group ltc2990_mode_group = {
+	.attrs = ltc2990_mode_attrs,
+};
+
+static const struct attribute_group *ltc2990_groups[] = {
+	&ltc2990_group,
+	&ltc2990_mode_group,
+#ifdef CONFIG_SENSORS_LTC2990_CACHE
+	&ltc2990_cache_group,
+#endif
+#ifdef CONFIG_SENSORS_LTC2990_HISTORY
+	&ltc2990_history_group,
+#endif
+	NULL,
+};
+
+#ifdef CONFIG_SENSORS_LTC2990_IIO
+#define LTC2990_IIO_TYPE_TEMP		IIO_TEMP
+#define LTC2990_IIO_TYPE_DIFF		IIO_CURRENT
+#define LTC2990_IIO_TYPE_SINGLE		IIO_VOLTAGE
+#define LTC2990_IIO_TYPE_VCC		IIO_VOLTAGE
+
+#define LTC2990_IIO_CHAN(_id, _name, _index, _reg, _conv) {		\
+	.type = LTC2990_IIO_TYPE_##_conv,				\
+	.indexed = 1,							\
+	.channel = (_index),						\
+	.address = LTC2990_##_id,					\
+	.info_mask_separate = BIT(IIO_CHAN_INFO_PROCESSED),		\
+},
+
+static const struct iio_chan_spec ltc2990_iio_channels[] = {
+	LTC2990_CHANNELS(LTC2990_IIO_CHAN)
+};
+
+static int ltc2990_iio_read_raw(struct iio_dev *indio_dev,
+				struct iio_chan_spec const *chan,
+				int *val, int *val2, long mask)
+{
+	struct ltc2990_data **data = iio_priv(indio_dev);
+	int ret;
+
+	if (mask != IIO_CHAN_INFO_PROCESSED)
+		return -EINVAL;
+	if (!ltc2990_chan_active(*data, chan->address))
+		return -ENODATA;
+
+	ret = ltc2990_read(*data, chan->address, val);
+	if (ret < 0)
+		return ret;
+
+	return IIO_VAL_INT;
+}
+
+static ssize_t ltc2990_iio_show_mode(struct device *dev,
+				     struct device_attribute *da, char *buf)
+{
+	struct ltc2990_data **data = iio_priv(dev_to_iio_dev(dev));
+
+	return snprintf(buf, PAGE_SIZE, "%u\n", READ_ONCE((*data)->mode));
+}
+
+static ssize_t ltc2990_iio_set_mode(struct device *dev,
+				    struct device_attribute *da,
+				    const char *buf, size_t count)
+{
+	struct ltc2990_data **data = iio_priv(dev_to_iio_dev(dev));
+
+	return ltc2990_store_mode(*data, buf, count);
+}
+
+static IIO_DEVICE_ATTR(mode, S_IRUGO | S_IWUSR, ltc2990_iio_show_mode,
+		       ltc2990_iio_set_mode, 0);
+
+static struct attribute *ltc2990_iio_attrs[] = {
+	&iio_dev_attr_mode.dev_attr.attr,
 	NULL,
 };
-ATTRIBUTE_GROUPS(ltc2990);
+
+static const struct attribute_group ltc2990_iio_attr_group = {
+	.attrs = ltc2990_iio_attrs,
+};
+
+static const struct iio_info ltc2990_iio_info = {
+	.read_raw	= ltc2990_iio_read_raw,
+	.attrs		= &ltc2990_iio_attr_group,
+	.driver_module	= THIS_MODULE,
+};
+
+static int ltc2990_iio_register(struct ltc2990_data *data)
+{
+	struct iio_dev *indio_dev;
+
+	indio_dev = devm_iio_device_alloc(&data->i2c->dev, sizeof(data));
+	if (!indio_dev)
+		return -ENOMEM;
+
+	*(struct ltc2990_data **)iio_priv(indio_dev) = data;
+	indio_dev->dev.parent = &data->i2c->dev;
+	indio_dev->name = data->i2c->name;
+	indio_dev->info = &ltc2990_iio_info;
+	indio_dev->modes = INDIO_DIRECT_MODE;
+	indio_dev->channels = ltc2990_iio_channels;
+	indio_dev->num_channels = ARRAY_SIZE(ltc2990_iio_channels);
+
+	return devm_iio_device_register(&data->i2c->dev, indio_dev);
+}
+#else
+static inline int ltc2990_iio_register(struct ltc2990_data *data)
+{
+	return 0;
+}
+#endif
+
+/*
+ * Upper bound of the histogram bucket holding the given fraction, in
+ * parts per 10000, of all recorded reads.
+ */
+static u64 ltc2990_instr_pct(struct ltc2990_instr *instr, unsigned int frac)
+{
+	u64 total = 0, rank, seen = 0;
+	int i;
+
+	for (i = 0; i < LTC2990_INSTR_BUCKETS; i++)
+		total += atomic_read(&instr->hist[i]);
+	if (!total)
+		return 0;
+
+	rank = DIV_ROUND_UP_ULL(total * frac, 10000);
+	for (i = 0; i < LTC2990_INSTR_BUCKETS - 1; i++) {
+		seen += atomic_read(&instr->hist[i]);
+		if (seen >= rank)
+			break;
+	}
+
+	return 1ULL << i;
+}
+
+static int ltc2990_instr_show(struct seq_file *s, void *unused)
+{
+	struct ltc2990_data *data = s->private;
+	struct ltc2990_instr *instr = &data->instr;
+	long reads = atomic_long_read(&instr->reads);
+	u64 total = atomic64_read(&instr->total_ns);
+	int i;
+
+	seq_printf(s, "reads:\t\t%ld\n", reads);
+	seq_printf(s, "errors:\t\t%ld\n", atomic_long_read(&instr->errors));
+	seq_printf(s, "mean_ns:\t%llu\n", reads ? div64_u64(total, reads) : 0);
+	seq_printf(s, "max_ns:\t\t%lld\n", atomic64_read(&instr->max_ns));
+	seq_printf(s, "last_ns:\t%lld\n", atomic64_read(&instr->last_ns));
+	seq_printf(s, "last_err_ns:\t%lld\n",
+		   atomic64_read(&instr->last_err_ns));
+	seq_printf(s, "p50_ns:\t\t< %llu\n", ltc2990_instr_pct(instr, 5000));
+	seq_printf(s, "p99_ns:\t\t< %llu\n", ltc2990_instr_pct(instr, 9900));
+	seq_printf(s, "p999_ns:\t< %llu\n", ltc2990_instr_pct(instr, 9990));
+
+	seq_puts(s, "histogram (ns):\n");
+	for (i = 0; i < LTC2990_INSTR_BUCKETS; i++) {
+		int count = atomic_read(&instr->hist[i]);
+
+		if (count)
+			seq_printf(s, "  < %llu:\t%d\n", 1ULL << i, count);
+	}
+
+	return 0;
+}
+
+static int ltc2990_instr_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ltc2990_instr_show, inode->i_private);
+}
+
+/* Any write clears the counters */
+static ssize_t ltc2990_instr_write(struct file *file, const char __user *ubuf,
+				   size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct ltc2990_data *data = s->private;
+	struct ltc2990_instr *instr = &data->instr;
+	int i;
+
+	atomic_long_set(&instr->reads, 0);
+	atomic_long_set(&instr->errors, 0);
+	atomic64_set(&instr->total_ns, 0);
+	atomic64_set(&instr->max_ns, 0);
+	for (i = 0; i < LTC2990_INSTR_BUCKETS; i++)
+		atomic_set(&instr->hist[i], 0);
+
+	return count;
+}
+
+static const struct file_operations ltc2990_instr_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ltc2990_instr_open,
+	.read		= seq_read,
+	.write		= ltc2990_instr_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static ssize_t ltc2990_instr_enable_read(struct file *file,
+					 char __user *ubuf, size_t count,
+					 loff_t *ppos)
+{
+	char buf[3];
+
+	buf[0] = static_key_enabled(&ltc2990_instr_key) ? 'Y' : 'N';
+	buf[1] = '\n';
+	buf[2] = 0;
+
+	return simple_read_from_buffer(ubuf, count, ppos, buf, 2);
+}
+
+static ssize_t ltc2990_instr_enable_write(struct file *file,
+					  const char __user *ubuf,
+					  size_t count, loff_t *ppos)
+{
+	bool enable;
+	int ret;
+
+	ret = kstrtobool_from_user(ubuf, count, &enable);
+	if (ret)
+		return ret;
+
+	if (enable)
+		static_branch_enable(&ltc2990_instr_key);
+	else
+		static_branch_disable(&ltc2990_instr_key);
+
+	return count;
+}
+
+static const struct file_operations ltc2990_instr_enable_fops = {
+	.owner	= THIS_MODULE,
+	.read	= ltc2990_instr_enable_read,
+	.write	= ltc2990_instr_enable_write,
+	.llseek	= default_llseek,
+};
+
+static int ltc2990_mode_show(struct seq_file *s, void *unused)
+{
+	struct ltc2990_data *data = s->private;
+
+	mutex_lock(&ltc2990_devices_lock);
+	seq_printf(s, "mode:\t\t%u\n", data->mode);
+	seq_printf(s, "switches:\t%u\n", data->mode_switches);
+	seq_printf(s, "switch_ns:\t%u\n", data->mode_switch_ns);
+	seq_printf(s, "switch_max_ns:\t%u\n", data->mode_switch_max_ns);
+	mutex_unlock(&ltc2990_devices_lock);
+
+	return 0;
+}
+
+static int ltc2990_mode_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ltc2990_mode_show, inode->i_private);
+}
+
+static const struct file_operations ltc2990_mode_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ltc2990_mode_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void ltc2990_debugfs_remove(void *arg)
+{
+	struct ltc2990_data *data = arg;
+
+	debugfs_remove_recursive(data->debugfs);
+}
+
+static int ltc2990_footprint_show(struct seq_file *s, void *unused)
+{
+	seq_printf(s, "data_size:\t%zu\n", sizeof(struct ltc2990_data));
+	seq_printf(s, "object_size:\t%u\n",
+		   kmem_cache_size(ltc2990_data_cache));
+	seq_printf(s, "cache_line:\t%u\n", L1_CACHE_BYTES);
+
+	return 0;
+}
+
+static int ltc2990_footprint_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ltc2990_footprint_show, NULL);
+}
+
+static const struct file_operations ltc2990_footprint_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ltc2990_footprint_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int ltc2990_debugfs_init(struct ltc2990_data *data)
+{
+	data->debugfs = debugfs_create_dir(dev_name(&data->i2c->dev),
+					   ltc2990_debugfs_root);
+	debugfs_create_file("stats", S_IRUGO | S_IWUSR, data->debugfs, data,
+			    &ltc2990_instr_fops);
+	debugfs_create_file("mode", S_IRUGO, data->debugfs, data,
+			    &ltc2990_mode_fops);
+	ltc2990_cache_debugfs_init(data);
+	ltc2990_filter_debugfs_init(data);
+
+	return devm_add_action_or_reset(&data->i2c->dev,
+					ltc2990_debugfs_remove, data);
+}
+
+static void ltc2990_data_free(void *arg)
+{
+	kmem_cache_free(ltc2990_data_cache, arg);
+}
 
 static int ltc2990_i2c_probe(struct i2c_client *i2c,
 			     const struct i2c_device_id *id)
 {
 	int ret;
 	struct device *hwmon_dev;
+	struct ltc2990_data *data;
 
 	if (!i2c_check_functionality(i2c->adapter, I2C_FUNC_SMBUS_BYTE_DATA |
 				     I2C_FUNC_SMBUS_WORD_DATA))
 		return -ENODEV;
 
+	data = kmem_cache_zalloc(ltc2990_data_cache, GFP_KERNEL);
+	if (!data)
+		return -ENOMEM;
+	ret = devm_add_action_or_reset(&i2c->dev, ltc2990_data_free, data);
+	if (ret)
+		return ret;
+	data->i2c = i2c;
+	data->mode = LTC2990_CONTROL_MODE_CURRENT;
+	i2c_set_clientdata(i2c, data);
+	ltc2990_cache_init(data);
+	ltc2990_cursors_init(data);
+
 	/* Setup continuous mode, current monitor */
 	ret = i2c_smbus_write_byte_data(i2c, LTC2990_CONTROL,
 					LTC2990_CONTROL_MEASURE_ALL |
-					LTC2990_CONTROL_MODE_CURRENT);
+					data->mode);
 	if (ret < 0) {
 		dev_err(&i2c->dev, "Error: Failed to set control mode.\n");
 		return ret;
@@ -132,12 +2426,32 @@ static int ltc2990_i2c_probe(struct i2c_client *i2c,
 		return ret;
 	}
 
+	ret = ltc2990_characterize(data);
+	if (ret < 0) {
+		dev_err(&i2c->dev, "Error: Failed to read measurements.\n");
+		return ret;
+	}
+
+	ret = ltc2990_debugfs_init(data);
+	if (ret)
+		return ret;
+
 	hwmon_dev = devm_hwmon_device_register_with_groups(&i2c->dev,
 							   i2c->name,
-							   i2c,
+							   data,
 							   ltc2990_groups);
+	if (IS_ERR(hwmon_dev))
+		return PTR_ERR(hwmon_dev);
+	/* the mode attribute is already live, see ltc2990_set_mode() */
+	mutex_lock(&ltc2990_devices_lock);
+	data->hwmon_dev = hwmon_dev;
+	mutex_unlock(&ltc2990_devices_lock);
 
-	return PTR_ERR_OR_ZERO(hwmon_dev);
+	ret = ltc2990_iio_register(data);
+	if (ret)
+		return ret;
+
+	return ltc2990_device_add(data);
 }
 
 static const struct i2c_device_id ltc2990_i2c_id[] = {
@@ -154,7 +2468,57 @@ static struct i2c_driver ltc2990_i2c_driver = {
 	.id_table = ltc2990_i2c_id,
 };
 
-module_i2c_driver(ltc2990_i2c_driver);
+static int __init ltc2990_init(void)
+{
+	int ret;
+
+	ltc2990_data_cache = KMEM_CACHE(ltc2990_data, SLAB_HWCACHE_ALIGN);
+	if (!ltc2990_data_cache)
+		return -ENOMEM;
+
+	ltc2990_debugfs_root = debugfs_create_dir("ltc2990", NULL);
+	debugfs_create_file("instrumentation", S_IRUGO | S_IWUSR,
+			    ltc2990_debugfs_root, NULL,
+			    &ltc2990_instr_enable_fops);
+	debugfs_create_file("footprint", S_IRUGO, ltc2990_debugfs_root, NULL,
+			    &ltc2990_footprint_fops);
+	ltc2990_sampler_debugfs_init();
+
+	ret = ltc2990_genl_init();
+	if (ret)
+		goto err_genl;
+
+	ret = ltc2990_ctl_init();
+	if (ret)
+		goto err_ctl;
+
+	ret = i2c_add_driver(&ltc2990_i2c_driver);
+	if (ret)
+		goto err_driver;
+
+	return 0;
+
+err_driver:
+	ltc2990_ctl_exit();
+err_ctl:
+	ltc2990_genl_exit();
+err_genl:
+	debugfs_remove_recursive(ltc2990_debugfs_root);
+	kmem_cache_destroy(ltc2990_data_cache);
+	return ret;
+}
+module_init(ltc2990_init);
+
+static void __exit ltc2990_exit(void)
+{
+	ltc2990_ctl_exit();
+	i2c_del_driver(&ltc2990_i2c_driver);
+	ltc2990_sampler_exit();
+	ltc2990_genl_exit();
+	debugfs_remove_recursive(ltc2990_debugfs_root);
+	kmem_cache_destroy(ltc2990_data_cache);
+}
+module_exit(ltc2990_exit);
 
 MODULE_DESCRIPTION("LTC2990 Sensor Driver");
 MODULE_AUTHOR("Topic Embedded Products");
@@ -0,0 +1,117 @@
+/*
+ * Userspace interface of the LTC2990 driver control device
+ *
+ * Copyright (C) 2014 Topic Embedded Products
+ *
+ * License: GPLv2
+ */
+
+#ifndef _UAPI_LINUX_LTC2990_H
+#define _UAPI_LINUX_LTC2990_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/* Channel indices into ltc2990_snapshot.value and the valid bitmap */
+enum ltc2990_channel {
+	LTC2990_CHAN_TEMP1,	/* internal temperature, mC */
+	LTC2990_CHAN_TEMP2,	/* remote temperature TR1, mC */
+	LTC2990_CHAN_TEMP3,	/* remote temperature TR2, mC */
+	LTC2990_CHAN_CURR1,	/* V1-V2, uV (mA across 1mOhm) */
+	LTC2990_CHAN_CURR2,	/* V3-V4, uV (mA across 1mOhm) */
+	LTC2990_CHAN_IN0,	/* Vcc, mV */
+	LTC2990_CHAN_IN1,	/* V1, mV */
+	LTC2990_CHAN_IN2,	/* V2, mV */
+	LTC2990_CHAN_IN3,	/* V3, mV */
+	LTC2990_CHAN_IN4,	/* V4, mV */
+	LTC2990_CHAN_COUNT
+};
+
+struct ltc2990_snapshot {
+	__u32 adapter;		/* I2C adapter number */
+	__u16 addr;		/* I2C address */
+	__u8 mode;		/* measurement mode, CONTROL[2:0] */
+	__u8 reserved;
+	__u32 valid;		/* bitmap of channels holding valid data */
+	__u32 reserved2;
+	__u64 timestamp;	/* CLOCK_MONOTONIC ns of the measurement */
+	__s32 value[LTC2990_CHAN_COUNT];
+};
+
+struct ltc2990_snapshot_req {
+	__u32 count;		/* in: entries at snapshots, out: filled */
+	__u32 total;		/* out: number of bound devices */
+	__u64 snapshots;	/* pointer to struct ltc2990_snapshot[count] */
+};
+
+/*
+ * Returned by read() on the control device, one per device: the valid
+ * samples of every channel since the previous read of the same handle.
+ */
+struct ltc2990_interval {
+	__u32 adapter;		/* I2C adapter number */
+	__u16 addr;		/* I2C address */
+	__u8 mode;		/* measurement mode at the read */
+	__u8 reserved;
+	__u32 valid;		/* bitmap of channels with count > 0 */
+	__u32 refreshes;	/* cache refreshes in the interval */
+	__u64 t_first;		/* CLOCK_MONOTONIC ns of the first refresh */
+	__u64 t_last;		/* and of the last one */
+	__u32 count[LTC2990_CHAN_COUNT];
+	__s32 min[LTC2990_CHAN_COUNT];
+	__s32 max[LTC2990_CHAN_COUNT];
+	__s32 mean[LTC2990_CHAN_COUNT];
+};
+
+#define LTC2990_IOC_MAGIC	0xB9
+
+/* Snapshot all bound devices in one call */
+#define LTC2990_IOC_SNAPSHOT	_IOWR(LTC2990_IOC_MAGIC, 0x01, \
+				      struct ltc2990_snapshot_req)
+
+/* Generic netlink family publishing the sampler scans */
+#define LTC2990_GENL_NAME		"ltc2990"
+#define LTC2990_GENL_VERSION		1
+#define LTC2990_GENL_MCGRP_SAMPLES	"samples"
+
+enum ltc2990_genl_cmd {
+	LTC2990_CMD_UNSPEC,
+	LTC2990_CMD_SAMPLES,	/* one batch of a sampler scan */
+	__LTC2990_CMD_MAX,
+};
+#define LTC2990_CMD_MAX		(__LTC2990_CMD_MAX - 1)
+
+enum ltc2990_genl_attr {
+	LTC2990_ATTR_UNSPEC,
+	LTC2990_ATTR_PAD,
+	LTC2990_ATTR_SCAN,	/* u32, scan sequence number */
+	LTC2990_ATTR_FIRST,	/* u32, index of the first device in batch */
+	LTC2990_ATTR_TOTAL,	/* u32, devices in the whole scan */
+	LTC2990_ATTR_SNAPSHOTS,	/* struct ltc2990_snapshot[] */
+	__LTC2990_ATTR_MAX,
+};
+#define LTC2990_ATTR_MAX	(__LTC2990_ATTR_MAX - 1)
+
+/*
+ * Register trace replayed by the ltc2990-emu module, little endian. The
+ * header is followed by count records in ascending time order.
+ */
+#define LTC2990_TRACE_MAGIC	0x5443544c	/* "LTCT" */
+#define LTC2990_TRACE_VERSION	2
+
+struct ltc2990_trace_hdr {
+	__le32 magic;
+	__le16 version;
+	__u8 mode;		/* CONTROL[2:0] of the recorded device */
+	__u8 reserved;
+	__le32 count;
+	__le32 reserved2;
+};
+
+struct ltc2990_trace_rec {
+	__le64 t_us;		/* since the first record */
+	__le16 raw[6];		/* TINT, V1, V2, V3, V4, VCC */
+	__le32 reserved;	/* keeps the size 24 on all ABIs */
+};
+
+#endif /* _UAPI_LINUX_LTC2990_H */
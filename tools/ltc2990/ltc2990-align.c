@@ -0,0 +1,243 @@
+/*
+ * Time alignment of LTC2990 sample streams
+ *
+ * Copyright (C) 2014 Topic Embedded Products
+ *
+ * License: GPLv2
+ *
+ * See ltc2990-align.h. Pushing a snapshot is a copy into the device's
+ * ring. Producing a row first picks, per device, the two samples around
+ * the row time and stores them as a base value, a slope and a weight. The
+ * interpolation then runs over all devices one channel at a time, in
+ * loops without branches the compiler turns into SIMD code.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ltc2990-align.h"
+
+int ltc2990_align_init(struct ltc2990_align *a, unsigned int max_devices,
+		       __u64 period, __u64 latency)
+{
+	size_t n = (size_t)max_devices * LTC2990_CHAN_COUNT;
+	unsigned int slots = 1;
+
+	memset(a, 0, sizeof(*a));
+	if (!max_devices || !period)
+		return -EINVAL;
+
+	/* at most half full, so probe sequences stay short */
+	while (slots < 2 * max_devices)
+		slots <<= 1;
+
+	a->max_devices = max_devices;
+	a->period = period;
+	a->latency = latency;
+	a->index_mask = slots - 1;
+	a->devs = calloc(max_devices, sizeof(*a->devs));
+	a->index = calloc(slots, sizeof(*a->index));
+	a->v0 = calloc(n, sizeof(*a->v0));
+	a->dv = calloc(n, sizeof(*a->dv));
+	a->w = calloc(max_devices, sizeof(*a->w));
+	if (!a->devs || !a->index || !a->v0 || !a->dv || !a->w) {
+		ltc2990_align_free(a);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+void ltc2990_align_free(struct ltc2990_align *a)
+{
+	free(a->devs);
+	free(a->index);
+	free(a->v0);
+	free(a->dv);
+	free(a->w);
+	memset(a, 0, sizeof(*a));
+}
+
+int ltc2990_align_row_init(struct ltc2990_align_row *r,
+			   const struct ltc2990_align *a)
+{
+	memset(r, 0, sizeof(*r));
+	r->stride = a->max_devices;
+	r->valid = calloc(a->max_devices, sizeof(*r->valid));
+	r->stale = calloc(a->max_devices, sizeof(*r->stale));
+	r->value = calloc((size_t)a->max_devices * LTC2990_CHAN_COUNT,
+			  sizeof(*r->value));
+	if (!r->valid || !r->stale || !r->value) {
+		ltc2990_align_row_free(r);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+void ltc2990_align_row_free(struct ltc2990_align_row *r)
+{
+	free(r->valid);
+	free(r->stale);
+	free(r->value);
+	memset(r, 0, sizeof(*r));
+}
+
+/* Device index of a snapshot, adding the device when first seen */
+static int ltc2990_align_find(struct ltc2990_align *a,
+			      const struct ltc2990_snapshot *s)
+{
+	__u32 key = s->adapter << 10 | s->addr;
+	unsigned int slot = (key * 0x9e3779b1u) >> 16 & a->index_mask;
+	struct ltc2990_align_dev *dev;
+
+	/* linear probing, the table never fills */
+	for (; a->index[slot]; slot = (slot + 1) & a->index_mask) {
+		dev = &a->devs[a->index[slot] - 1];
+		if (dev->adapter == s->adapter && dev->addr == s->addr)
+			return a->index[slot] - 1;
+	}
+
+	if (a->nr_devices == a->max_devices)
+		return -ENOSPC;
+	dev = &a->devs[a->nr_devices];
+	dev->adapter = s->adapter;
+	dev->addr = s->addr;
+	a->index[slot] = ++a->nr_devices;
+	return a->nr_devices - 1;
+}
+
+int ltc2990_align_push(struct ltc2990_align *a,
+		       const struct ltc2990_snapshot *s)
+{
+	struct ltc2990_align_dev *dev;
+	int d = ltc2990_align_find(a, s);
+
+	if (d < 0)
+		return d;
+
+	dev = &a->devs[d];
+	if (dev->count && s->timestamp <= dev->t[dev->head])
+		return d;
+
+	/* the grid starts at the first period boundary after any sample */
+	if (!a->next)
+		a->next = (s->timestamp / a->period + 1) * a->period;
+	if ((!dev->count || dev->t[dev->head] < a->next) &&
+	    s->timestamp >= a->next)
+		a->ready++;
+
+	dev->head = (dev->head + 1) % LTC2990_ALIGN_DEPTH;
+	if (dev->count < LTC2990_ALIGN_DEPTH)
+		dev->count++;
+	dev->t[dev->head] = s->timestamp;
+	dev->valid[dev->head] = s->valid;
+	memcpy(dev->value[dev->head], s->value, sizeof(dev->value[0]));
+
+	return d;
+}
+
+/* Count the devices that have a sample at or after the next row time */
+static void ltc2990_align_recount(struct ltc2990_align *a)
+{
+	unsigned int d;
+
+	a->ready = 0;
+	for (d = 0; d < a->nr_devices; d++) {
+		const struct ltc2990_align_dev *dev = &a->devs[d];
+
+		a->ready += dev->count && dev->t[dev->head] >= a->next;
+	}
+}
+
+/*
+ * Set up device d for interpolation at t: the newest sample at or before
+ * t and the one after it, or the newest alone if none came after yet.
+ */
+static void ltc2990_align_bracket(struct ltc2990_align *a, unsigned int d,
+				  __u64 t, struct ltc2990_align_row *r)
+{
+	const struct ltc2990_align_dev *dev = &a->devs[d];
+	unsigned int stride = a->max_devices;
+	unsigned int i = dev->head, j = dev->head, k, ch;
+
+	for (k = 0; k < dev->count && dev->t[i] > t; k++) {
+		j = i;
+		i = (i + LTC2990_ALIGN_DEPTH - 1) % LTC2990_ALIGN_DEPTH;
+	}
+
+	r->stale[d] = 0;
+	if (k == dev->count) {
+		/* nothing at or before t, started late or fell out of the ring */
+		r->valid[d] = 0;
+		a->w[d] = 0;
+		for (ch = 0; ch < LTC2990_CHAN_COUNT; ch++) {
+			a->v0[ch * stride + d] = 0;
+			a->dv[ch * stride + d] = 0;
+		}
+		return;
+	}
+
+	if (i == j) {
+		r->stale[d] = dev->t[i] < t;
+		r->valid[d] = dev->valid[i];
+		a->w[d] = 0;
+	} else {
+		r->valid[d] = dev->valid[i] & dev->valid[j];
+		a->w[d] = (float)(t - dev->t[i]) /
+			  (float)(dev->t[j] - dev->t[i]);
+	}
+
+	for (ch = 0; ch < LTC2990_CHAN_COUNT; ch++) {
+		a->v0[ch * stride + d] = dev->value[i][ch];
+		a->dv[ch * stride + d] = (float)dev->value[j][ch] -
+					 (float)dev->value[i][ch];
+	}
+}
+
+int ltc2990_align_pop(struct ltc2990_align *a, __u64 now,
+		      struct ltc2990_align_row *r)
+{
+	unsigned int n = a->nr_devices, stride = a->max_devices, d, ch;
+	__u64 t = a->next;
+
+	if (!t || (a->ready < n && now < t + a->latency))
+		return 0;
+
+	for (d = 0; d < n; d++)
+		ltc2990_align_bracket(a, d, t, r);
+
+	for (ch = 0; ch < LTC2990_CHAN_COUNT; ch++) {
+		const float *v0 = a->v0 + ch * stride;
+		const float *dv = a->dv + ch * stride;
+		const float *w = a->w;
+		__s32 *out = r->value + ch * stride;
+
+		for (d = 0; d < n; d++) {
+			float x = v0[d] + w[d] * dv[d];
+
+			/* round half away from zero, without a branch */
+			out[d] = (__s32)(x + copysignf(0.5f, x));
+		}
+	}
+
+	r->t = t;
+	r->nr_devices = n;
+	a->next = t + a->period;
+	ltc2990_align_recount(a);
+	return 1;
+}
+
+__s64 ltc2990_align_sum(const struct ltc2990_align_row *r, unsigned int ch)
+{
+	const __s32 *v = ltc2990_align_channel(r, ch);
+	__s64 sum = 0;
+	unsigned int d;
+
+	for (d = 0; d < r->nr_devices; d++)
+		sum += v[d] & -(__s32)(r->valid[d] >> ch & 1);
+
+	return sum;
+}
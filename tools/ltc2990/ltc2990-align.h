@@ -0,0 +1,101 @@
+/*
+ * Time alignment of LTC2990 sample streams
+ *
+ * Copyright (C) 2014 Topic Embedded Products
+ *
+ * License: GPLv2
+ *
+ * Every chip is refreshed on its own schedule, so the snapshots of several
+ * devices carry slightly different timestamps and drift apart over time.
+ * An aligner takes the snapshots of any number of devices, as returned by
+ * LTC2990_IOC_SNAPSHOT or the sample multicast, and produces rows on a
+ * common time grid: every period ns, each device's channels linearly
+ * interpolated between the two samples around the row time.
+ *
+ * A row is handed out as soon as every device has a sample at or after its
+ * time, or once it is latency ns old by the caller's clock, whichever comes
+ * first. Devices that are late at that point hold their last value and are
+ * flagged stale, so a stalled device delays the stream by latency at most.
+ * Each device keeps its last LTC2990_ALIGN_DEPTH samples, which must span
+ * latency plus two of its sample periods.
+ *
+ * Rows are stored channel major, value[ch * stride + device], so per
+ * channel operations over all devices run on contiguous memory and the
+ * interpolation and sums vectorize.
+ */
+
+#ifndef LTC2990_ALIGN_H
+#define LTC2990_ALIGN_H
+
+#include <linux/ltc2990.h>
+#include <linux/types.h>
+
+#define LTC2990_ALIGN_DEPTH	16
+
+struct ltc2990_align_dev {
+	__u32 adapter;
+	__u16 addr;
+	unsigned int head;		/* newest sample */
+	unsigned int count;
+	__u64 t[LTC2990_ALIGN_DEPTH];
+	__u32 valid[LTC2990_ALIGN_DEPTH];
+	__s32 value[LTC2990_ALIGN_DEPTH][LTC2990_CHAN_COUNT];
+};
+
+struct ltc2990_align {
+	unsigned int nr_devices;
+	unsigned int max_devices;	/* also the row stride */
+	unsigned int ready;		/* devices with a sample at or after next */
+	__u64 period;			/* ns between rows */
+	__u64 latency;			/* ns a row waits for late devices */
+	__u64 next;			/* time of the next row, 0 until known */
+	struct ltc2990_align_dev *devs;
+	unsigned int *index;		/* hash of adapter/addr to device + 1 */
+	unsigned int index_mask;
+	float *v0;			/* interpolation scratch, channel major */
+	float *dv;
+	float *w;			/* per device */
+};
+
+struct ltc2990_align_row {
+	__u64 t;			/* CLOCK_MONOTONIC ns */
+	unsigned int nr_devices;	/* in the order first pushed */
+	unsigned int stride;
+	__u32 *valid;			/* channels valid per device */
+	__u8 *stale;			/* devices held at their last sample */
+	__s32 *value;			/* value[ch * stride + device] */
+};
+
+/* All return 0 or a negative errno */
+int ltc2990_align_init(struct ltc2990_align *a, unsigned int max_devices,
+		       __u64 period, __u64 latency);
+void ltc2990_align_free(struct ltc2990_align *a);
+int ltc2990_align_row_init(struct ltc2990_align_row *r,
+			   const struct ltc2990_align *a);
+void ltc2990_align_row_free(struct ltc2990_align_row *r);
+
+/*
+ * Add a snapshot. Returns the device index, or -ENOSPC for a device past
+ * max_devices. A snapshot not newer than the device's last one, as
+ * returned when polling faster than the device refreshes, is ignored.
+ */
+int ltc2990_align_push(struct ltc2990_align *a,
+		       const struct ltc2990_snapshot *s);
+
+/*
+ * Fill r with the next row if it is due at now, CLOCK_MONOTONIC ns.
+ * Returns 1 if a row was produced, 0 if not. Call until it returns 0.
+ */
+int ltc2990_align_pop(struct ltc2990_align *a, __u64 now,
+		      struct ltc2990_align_row *r);
+
+/* Sum of a channel over the devices where it is valid, e.g. total current */
+__s64 ltc2990_align_sum(const struct ltc2990_align_row *r, unsigned int ch);
+
+static inline __s32 *ltc2990_align_channel(const struct ltc2990_align_row *r,
+					   unsigned int ch)
+{
+	return r->value + ch * r->stride;
+}
+
+#endif /* LTC2990_ALIGN_H */
@@ -0,0 +1,208 @@
+/*
+ * ltc2990-alignbench: cost and accuracy of aligning LTC2990 sample streams
+ *
+ * Copyright (C) 2014 Topic Embedded Products
+ *
+ * License: GPLv2
+ *
+ * Simulates devices refreshing at slightly different periods and phases,
+ * each with a small timestamp jitter. curr1 follows a known sine wave and
+ * the other channels ramps. The snapshots are generated ahead in chunks
+ * and then timed going through the aligner in time order, as a reader of
+ * the sample multicast would see them. Every row is summed over all
+ * devices:
+ *
+ *   ltc2990-alignbench [-d devices] [-p period_us] [-l latency_us]
+ *		        [-s seconds]
+ *
+ * Defaults are 64 devices and 10 ms rows, matching the sampler at 100 Hz,
+ * with 20 ms latency, over 600 simulated seconds. Reports the time spent
+ * in the aligner per snapshot and per row and how much faster than real
+ * time that is. A second, untimed aligner is fed the same snapshots to
+ * find the largest curr1 interpolation error against the sine and the
+ * number of rows that had to hold a stale device.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ltc2990-align.h"
+
+#define SINE_UV		20000.0		/* curr1 amplitude */
+#define SINE_HZ		0.5
+
+/* Snapshots generated ahead of each timed run through the aligner */
+#define CHUNK		65536
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double curr1(unsigned int d, __u64 t)
+{
+	return SINE_UV * sin(2 * M_PI * SINE_HZ * t / 1e9 + d);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [-d devices] [-p period_us] [-l latency_us] [-s seconds]\n",
+		name);
+	exit(EXIT_FAILURE);
+}
+
+/* Rows with a stale device, and the largest curr1 error against the sine */
+static void check(const struct ltc2990_align *a,
+		  const struct ltc2990_align_row *r, unsigned long *stale_rows,
+		  double *max_err)
+{
+	const __s32 *c = ltc2990_align_channel(r, LTC2990_CHAN_CURR1);
+	unsigned int d, stale = 0;
+	double err;
+
+	for (d = 0; d < r->nr_devices; d++) {
+		const struct ltc2990_align_dev *dev = &a->devs[d];
+
+		stale |= r->stale[d];
+		if (r->stale[d] || !r->valid[d])
+			continue;
+		err = fabs(c[d] - curr1(dev->adapter * 8 + dev->addr - 0x4c,
+					r->t));
+		if (err > *max_err)
+			*max_err = err;
+	}
+	*stale_rows += stale;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long pushed = 0, rows = 0, stale_rows = 0, n, i;
+	unsigned int devices = 64, period_us = 10000, latency_us = 20000;
+	unsigned int seconds = 600, d, ch;
+	unsigned long long spent = 0, start;
+	struct ltc2990_snapshot *chunk;
+	struct ltc2990_align a, ref;
+	struct ltc2990_align_row r, rr;
+	__u64 *next, *dev_period, end;
+	double max_err = 0;
+	volatile __s64 total;
+	int opt, ret;
+
+	while ((opt = getopt(argc, argv, "d:p:l:s:")) != -1) {
+		switch (opt) {
+		case 'd':
+			devices = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			period_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			latency_us = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			seconds = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc || !devices || !period_us || !seconds)
+		usage(argv[0]);
+
+	ret = ltc2990_align_init(&a, devices, period_us * 1000ULL,
+				 latency_us * 1000ULL);
+	if (!ret)
+		ret = ltc2990_align_init(&ref, devices, period_us * 1000ULL,
+					 latency_us * 1000ULL);
+	if (!ret)
+		ret = ltc2990_align_row_init(&r, &a);
+	if (!ret)
+		ret = ltc2990_align_row_init(&rr, &ref);
+	next = calloc(devices, sizeof(*next));
+	dev_period = calloc(devices, sizeof(*dev_period));
+	chunk = calloc(CHUNK, sizeof(*chunk));
+	if (ret || !next || !dev_period || !chunk) {
+		fprintf(stderr, "setup: %s\n", strerror(ret ? -ret : ENOMEM));
+		return EXIT_FAILURE;
+	}
+
+	/* periods within +-0.3% of the row period, phases spread over it */
+	srand(1);
+	for (d = 0; d < devices; d++) {
+		dev_period[d] = period_us * (1000ULL + d % 7 - 3);
+		next[d] = 1000000000ULL + period_us * 1000ULL * d / devices;
+	}
+	end = 1000000000ULL + seconds * 1000000000ULL;
+
+	do {
+		/* the next CHUNK snapshots in arrival order */
+		for (n = 0; n < CHUNK; n++) {
+			struct ltc2990_snapshot *s = &chunk[n];
+			unsigned int first = 0;
+
+			for (d = 1; d < devices; d++)
+				if (next[d] < next[first])
+					first = d;
+			if (next[first] >= end)
+				break;
+
+			s->adapter = first / 8;
+			s->addr = 0x4c + first % 8;
+			s->valid = (1u << LTC2990_CHAN_COUNT) - 1;
+			s->timestamp = next[first] + rand() % 20000;
+			for (ch = 0; ch < LTC2990_CHAN_COUNT; ch++)
+				s->value[ch] = (s->timestamp / 1000000) % 1000 +
+					       ch;
+			s->value[LTC2990_CHAN_CURR1] =
+				lround(curr1(first, s->timestamp));
+			next[first] += dev_period[first];
+		}
+
+		start = now_ns();
+		for (i = 0; i < n; i++) {
+			ltc2990_align_push(&a, &chunk[i]);
+			while (ltc2990_align_pop(&a, chunk[i].timestamp, &r)) {
+				total = ltc2990_align_sum(&r,
+							  LTC2990_CHAN_CURR1);
+				rows++;
+			}
+		}
+		spent += now_ns() - start;
+		pushed += n;
+
+		/* the same again, untimed, checking every row */
+		for (i = 0; i < n; i++) {
+			ltc2990_align_push(&ref, &chunk[i]);
+			while (ltc2990_align_pop(&ref, chunk[i].timestamp, &rr))
+				check(&ref, &rr, &stale_rows, &max_err);
+		}
+	} while (n == CHUNK);
+	(void)total;
+
+	printf("devices:\t%u\n", devices);
+	printf("snapshots:\t%lu\n", pushed);
+	printf("rows:\t\t%lu\n", rows);
+	printf("stale_rows:\t%lu\n", stale_rows);
+	printf("cost:\t\t%.1f ns/snapshot\t%.1f ns/row\n",
+	       (double)spent / pushed, rows ? (double)spent / rows : 0.0);
+	printf("realtime:\t%.0fx\n", seconds * 1e9 / (double)spent);
+	printf("max_error:\t%.1f uV\n", max_err);
+
+	ltc2990_align_row_free(&r);
+	ltc2990_align_row_free(&rr);
+	ltc2990_align_free(&a);
+	ltc2990_align_free(&ref);
+	free(chunk);
+	free(next);
+	free(dev_period);
+	return EXIT_SUCCESS;
+}
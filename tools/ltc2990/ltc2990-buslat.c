@@ -0,0 +1,118 @@
+/*
+ * ltc2990-buslat: latency of a competing user of an LTC2990's I2C bus
+ *
+ * Copyright (C) 2014 Topic Embedded Products
+ *
+ * License: GPLv2
+ *
+ * Stands in for latency critical traffic sharing the adapter, such as a
+ * PMBus fault handler: reads one status byte from the given address
+ * through i2c-dev every interval and reports how long each transaction
+ * took, waiting for the bus included:
+ *
+ *   ltc2990-buslat [-n count] [-i interval_us] <bus> <addr>
+ *
+ * The address may be claimed by a driver; it is accessed with
+ * I2C_SLAVE_FORCE. ltc2990-contention.sh runs this against the emulator.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [-n count] [-i interval_us] <bus> <addr>\n", name);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long *samples, start, total = 0;
+	unsigned long count = 10000, interval = 1000, errors = 0, i;
+	union i2c_smbus_data byte;
+	struct i2c_smbus_ioctl_data args = {
+		.read_write = I2C_SMBUS_READ,
+		.command = 0,			/* STATUS */
+		.size = I2C_SMBUS_BYTE_DATA,
+		.data = &byte,
+	};
+	char path[32];
+	int fd, opt;
+	long addr;
+
+	while ((opt = getopt(argc, argv, "n:i:")) != -1) {
+		switch (opt) {
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			interval = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 2 || !count)
+		usage(argv[0]);
+
+	samples = calloc(count, sizeof(*samples));
+	if (!samples)
+		return EXIT_FAILURE;
+
+	snprintf(path, sizeof(path), "/dev/i2c-%s", argv[optind]);
+	addr = strtol(argv[optind + 1], NULL, 0);
+	fd = open(path, O_RDWR);
+	if (fd < 0 || ioctl(fd, I2C_SLAVE_FORCE, addr) < 0) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (interval)
+			usleep(interval);
+		start = now_ns();
+		if (ioctl(fd, I2C_SMBUS, &args) < 0)
+			errors++;
+		samples[i] = now_ns() - start;
+		total += samples[i];
+	}
+	close(fd);
+
+	qsort(samples, count, sizeof(*samples), cmp_ull);
+	printf("reads:\t%lu\n", count);
+	printf("errors:\t%lu\n", errors);
+	printf("mean:\t%llu ns\n", total / count);
+	printf("p50:\t%llu ns\n", samples[count / 2]);
+	printf("p99:\t%llu ns\n", samples[count * 99 / 100]);
+	printf("p999:\t%llu ns\n", samples[count * 999 / 1000]);
+	printf("max:\t%llu ns\n", samples[count - 1]);
+
+	free(samples);
+	return EXIT_SUCCESS;
+}
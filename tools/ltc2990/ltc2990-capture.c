@@ -0,0 +1,319 @@
+/*
+ * ltc2990-capture: record LTC2990 snapshots into a columnar capture
+ *
+ * Copyright (C) 2014 Topic Embedded Products
+ *
+ * License: GPLv2
+ *
+ * Records every new snapshot of every bound LTC2990 into the capture
+ * format of ltc2990-capture.h, until interrupted or for the given number
+ * of seconds:
+ *
+ *   ltc2990-capture [-b samples] [-i interval_ms] [-m] [-t seconds] file
+ *
+ * Snapshots come from polling /dev/ltc2990 every interval, or with -m from
+ * the sampler's netlink multicast. A snapshot whose timestamp equals the
+ * previous one of its device was served from the cache and is skipped, as
+ * are snapshots of devices not refreshed successfully yet.
+ * One block per device is filled in memory and appended when full; the
+ * partial blocks are appended on exit. Query the capture with
+ * ltc2990-query.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ltc2990-capture.h"
+#include "ltc2990-genl.h"
+
+#define MAX_DEVICES	1024
+
+struct device {
+	__u32 adapter;
+	__u16 addr;
+	struct ltc2990_cap_block *blk;
+};
+
+static struct device devs[MAX_DEVICES];
+static unsigned int nr_devs;
+static struct ltc2990_snapshot snaps[MAX_DEVICES];
+
+static struct ltc2990_cap_hdr hdr;
+static int out;
+static unsigned long long samples;
+static volatile sig_atomic_t stop;
+
+static char buf[65536] __attribute__((aligned(8)));
+
+static long long clock_ns(clockid_t clk)
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int flush(struct ltc2990_cap_block *b)
+{
+	off_t pos = LTC2990_CAP_ALIGN + (off_t)hdr.nr_blocks * hdr.block_size;
+
+	if (!b->count)
+		return 0;
+	if (pwrite(out, b, hdr.block_size, pos) != (ssize_t)hdr.block_size)
+		return -errno;
+	hdr.nr_blocks++;
+	if (pwrite(out, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+		return -errno;
+
+	return 0;
+}
+
+static void block_reset(struct ltc2990_cap_block *b,
+			const struct ltc2990_snapshot *s)
+{
+	memset(b, 0, sizeof(*b));
+	b->magic = LTC2990_CAP_BLOCK_MAGIC;
+	b->adapter = s->adapter;
+	b->addr = s->addr;
+	b->mode = s->mode;
+}
+
+static struct device *lookup(const struct ltc2990_snapshot *s)
+{
+	struct device *d;
+	unsigned int i;
+
+	for (i = 0; i < nr_devs; i++)
+		if (devs[i].adapter == s->adapter && devs[i].addr == s->addr)
+			return &devs[i];
+	if (nr_devs == MAX_DEVICES)
+		return NULL;
+
+	d = &devs[nr_devs];
+	d->blk = calloc(1, hdr.block_size);
+	if (!d->blk)
+		return NULL;
+	d->adapter = s->adapter;
+	d->addr = s->addr;
+	block_reset(d->blk, s);
+	nr_devs++;
+
+	return d;
+}
+
+static int append(const struct ltc2990_snapshot *s)
+{
+	unsigned int n = hdr.block_samples, i, ch;
+	struct ltc2990_cap_block *b;
+	struct device *d;
+	int ret;
+
+	/* never refreshed, there is no sample and no time to file it under */
+	if (!s->valid || !s->timestamp)
+		return 0;
+
+	d = lookup(s);
+	if (!d)
+		return -ENOMEM;
+	b = d->blk;
+
+	if (b->count && ltc2990_cap_time(b)[b->count - 1] == s->timestamp)
+		return 0;
+	/* a block holds one mode, so its columns mean the same throughout */
+	if (b->count == n || (b->count && b->mode != s->mode)) {
+		ret = flush(b);
+		if (ret)
+			return ret;
+		block_reset(b, s);
+	}
+
+	i = b->count++;
+	if (!i)
+		b->t_first = s->timestamp;
+	b->t_last = s->timestamp;
+	ltc2990_cap_time(b)[i] = s->timestamp;
+	ltc2990_cap_valid(b, n)[i] = s->valid;
+	b->valid |= s->valid;
+	for (ch = 0; ch < LTC2990_CHAN_COUNT; ch++) {
+		__s32 v = s->value[ch];
+
+		ltc2990_cap_column(b, n, ch)[i] = v;
+		if (!(s->valid & (1u << ch)))
+			continue;
+		if (!b->nvalid[ch] || v < b->min[ch])
+			b->min[ch] = v;
+		if (!b->nvalid[ch] || v > b->max[ch])
+			b->max[ch] = v;
+		b->sum[ch] += v;
+		b->nvalid[ch]++;
+	}
+	samples++;
+
+	return 0;
+}
+
+static int poll_ioctl(int fd)
+{
+	struct ltc2990_snapshot_req req;
+	unsigned int i;
+	int ret;
+
+	memset(&req, 0, sizeof(req));
+	req.count = MAX_DEVICES;
+	req.snapshots = (uintptr_t)snaps;
+	if (ioctl(fd, LTC2990_IOC_SNAPSHOT, &req) < 0)
+		return -errno;
+
+	for (i = 0; i < req.count; i++) {
+		ret = append(&snaps[i]);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int recv_netlink(int fd)
+{
+	const struct ltc2990_snapshot *s;
+	unsigned int count, i;
+	struct nlmsghdr *n;
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	int len, ret;
+
+	/* wake up now and then to check the -t deadline */
+	ret = poll(&pfd, 1, 1000);
+	if (ret <= 0)
+		return ret < 0 && errno != EINTR ? -errno : 0;
+
+	len = recv(fd, buf, sizeof(buf), 0);
+	if (len < 0)
+		return errno == EINTR || errno == ENOBUFS ? 0 : -errno;
+
+	for (n = (struct nlmsghdr *)buf; NLMSG_OK(n, (unsigned int)len);
+	     n = NLMSG_NEXT(n, len)) {
+		s = ltc2990_genl_snapshots(n, &count);
+		for (i = 0; i < count; i++) {
+			ret = append(&s[i]);
+			if (ret)
+				return ret;
+		}
+	}
+
+	return 0;
+}
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [-b samples] [-i interval_ms] [-m] [-t seconds] file\n",
+		name);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long block = 4096, interval = 100, secs = 0;
+	long long end = 0;
+	int multicast = 0;
+	struct sigaction sa;
+	unsigned int i;
+	int opt, src, ret = 0;
+
+	while ((opt = getopt(argc, argv, "b:i:mt:")) != -1) {
+		switch (opt) {
+		case 'b':
+			block = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			interval = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			multicast = 1;
+			break;
+		case 't':
+			secs = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || !block || block > (1 << 20) || !interval)
+		usage(argv[0]);
+
+	if (multicast) {
+		src = ltc2990_genl_subscribe(buf, sizeof(buf));
+	} else {
+		src = open("/dev/ltc2990", O_RDONLY);
+		if (src < 0)
+			src = -errno;
+	}
+	if (src < 0) {
+		fprintf(stderr, "%s: %s\n",
+			multicast ? LTC2990_GENL_NAME : "/dev/ltc2990",
+			strerror(-src));
+		return EXIT_FAILURE;
+	}
+
+	out = open(argv[optind], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (out < 0) {
+		perror(argv[optind]);
+		return EXIT_FAILURE;
+	}
+	hdr.magic = LTC2990_CAP_MAGIC;
+	hdr.version = LTC2990_CAP_VERSION;
+	hdr.block_samples = block;
+	hdr.block_size = ltc2990_cap_block_size(block);
+	hdr.realtime_offset = clock_ns(CLOCK_REALTIME) -
+			      clock_ns(CLOCK_MONOTONIC);
+	if (pwrite(out, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+		perror(argv[optind]);
+		return EXIT_FAILURE;
+	}
+
+	/* no SA_RESTART, a signal must interrupt a blocking recv */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	if (secs)
+		end = clock_ns(CLOCK_MONOTONIC) + secs * 1000000000LL;
+
+	while (!stop && !ret && (!end || clock_ns(CLOCK_MONOTONIC) < end)) {
+		if (multicast) {
+			ret = recv_netlink(src);
+		} else {
+			ret = poll_ioctl(src);
+			usleep(interval * 1000);
+		}
+	}
+	if (ret)
+		fprintf(stderr, "capture: %s\n", strerror(-ret));
+
+	for (i = 0; i < nr_devs; i++) {
+		if (flush(devs[i].blk))
+			perror(argv[optind]);
+		free(devs[i].blk);
+	}
+	close(out);
+	close(src);
+
+	fprintf(stderr, "%llu samples of %u devices in %llu blocks\n",
+		samples, nr_devs, (unsigned long long)hdr.nr_blocks);
+	return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,90 @@
+/*
+ * Columnar capture file written by ltc2990-capture
+ *
+ * Copyright (C) 2014 Topic Embedded Products
+ *
+ * License: GPLv2
+ *
+ * A capture is a file header followed by fixed-size, page aligned blocks.
+ * Each block holds up to block_samples consecutive snapshots of a single
+ * device, stored column-wise: the timestamps, then one column per channel,
+ * then the per-sample valid bitmaps. The block header carries the time
+ * span and, per channel, the minimum, maximum, sum and count of the valid
+ * samples, so a time range query only reads the columns of the blocks the
+ * range cuts through. Blocks of different devices are interleaved in the
+ * order they filled up; the blocks of one device are in time order.
+ *
+ * Everything is in host byte order, a capture read on a host of the other
+ * endianness fails the magic check.
+ */
+
+#ifndef LTC2990_CAPTURE_H
+#define LTC2990_CAPTURE_H
+
+#include <linux/ltc2990.h>
+#include <linux/types.h>
+
+#define LTC2990_CAP_MAGIC	0x4343544c	/* "LTCC" */
+#define LTC2990_CAP_BLOCK_MAGIC	0x4243544c	/* "LTCB" */
+#define LTC2990_CAP_VERSION	1
+#define LTC2990_CAP_ALIGN	4096
+
+struct ltc2990_cap_hdr {
+	__u32 magic;
+	__u16 version;
+	__u16 reserved;
+	__u32 block_samples;	/* capacity of a block */
+	__u32 block_size;	/* bytes per block, multiple of ALIGN */
+	__u64 nr_blocks;	/* blocks written, also implied by file size */
+	__s64 realtime_offset;	/* CLOCK_REALTIME - CLOCK_MONOTONIC, ns */
+};
+
+struct ltc2990_cap_block {
+	__u32 magic;
+	__u32 adapter;
+	__u16 addr;
+	__u8 mode;
+	__u8 reserved;
+	__u32 count;		/* samples in this block */
+	__u32 valid;		/* channels valid in any sample */
+	__u32 reserved2;
+	__u64 t_first;		/* CLOCK_MONOTONIC ns */
+	__u64 t_last;
+	__s32 min[LTC2990_CHAN_COUNT];
+	__s32 max[LTC2990_CHAN_COUNT];
+	__s64 sum[LTC2990_CHAN_COUNT];
+	__u32 nvalid[LTC2990_CHAN_COUNT];
+	/*
+	 * __u64 time[block_samples];
+	 * __s32 value[LTC2990_CHAN_COUNT][block_samples];
+	 * __u16 valid[block_samples];
+	 */
+};
+
+static inline unsigned int ltc2990_cap_block_size(unsigned int samples)
+{
+	unsigned int size = sizeof(struct ltc2990_cap_block) +
+			    samples * (sizeof(__u64) + sizeof(__u16) +
+				       LTC2990_CHAN_COUNT * sizeof(__s32));
+
+	return (size + LTC2990_CAP_ALIGN - 1) & ~(LTC2990_CAP_ALIGN - 1);
+}
+
+static inline __u64 *ltc2990_cap_time(struct ltc2990_cap_block *b)
+{
+	return (__u64 *)(b + 1);
+}
+
+static inline __s32 *ltc2990_cap_column(struct ltc2990_cap_block *b,
+					unsigned int samples, unsigned int ch)
+{
+	return (__s32 *)(ltc2990_cap_time(b) + samples) + ch * samples;
+}
+
+static inline __u16 *ltc2990_cap_valid(struct ltc2990_cap_block *b,
+				       unsigned int samples)
+{
+	return (__u16 *)ltc2990_cap_column(b, samples, LTC2990_CHAN_COUNT);
+}
+
+#endif /* LTC2990_CAPTURE_H */
@@ -0,0 +1,382 @@
+/*
+ * Header-only C++ client for the LTC2990 driver
+ *
+ * Copyright (C) 2014 Topic Embedded Products
+ *
+ * License: GPLv2
+ *
+ * Wraps the binary interfaces of the driver, the /dev/ltc2990 snapshot
+ * ioctl and the "samples" generic netlink group, in typed views. Values
+ * keep the integer units the driver reports and carry them in their type,
+ * so a temperature cannot be passed where a voltage is expected. Buffers
+ * are sized once; reading samples after that does not touch the heap.
+ *
+ *   ltc2990::snapshot_reader r;
+ *
+ *   if (r.open() == 0 && r.refresh() == 0)
+ *           for (auto s : r)
+ *                   if (s.valid(ltc2990::channel::in0))
+ *                           printf("%d mV\n", s.in(0).count());
+ *
+ * Errors are returned as negative errno values, like the C tools.
+ */
+
+#ifndef LTC2990_CLIENT_HPP
+#define LTC2990_CLIENT_HPP
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <linux/ltc2990.h>
+
+#include "ltc2990-genl.h"
+
+namespace ltc2990 {
+
+/* An integer value tagged with its unit */
+template <typename Unit>
+class quantity {
+public:
+	constexpr quantity() : v_(0) {}
+	explicit constexpr quantity(std::int32_t v) : v_(v) {}
+
+	constexpr std::int32_t count() const { return v_; }
+
+	constexpr bool operator==(quantity o) const { return v_ == o.v_; }
+	constexpr bool operator!=(quantity o) const { return v_ != o.v_; }
+	constexpr bool operator<(quantity o) const { return v_ < o.v_; }
+	constexpr bool operator>(quantity o) const { return v_ > o.v_; }
+	constexpr quantity operator+(quantity o) const { return quantity(v_ + o.v_); }
+	constexpr quantity operator-(quantity o) const { return quantity(v_ - o.v_); }
+
+private:
+	std::int32_t v_;
+};
+
+struct millidegree_unit {};
+struct microvolt_unit {};
+struct millivolt_unit {};
+struct milliamp_unit {};
+
+typedef quantity<millidegree_unit> millidegrees;
+typedef quantity<microvolt_unit> microvolts;
+typedef quantity<millivolt_unit> millivolts;
+typedef quantity<milliamp_unit> milliamps;
+
+inline constexpr microvolts to_microvolts(millivolts v)
+{
+	return microvolts(v.count() * 1000);
+}
+
+/* Current through a shunt of the given resistance, uV / mOhm = mA */
+inline constexpr milliamps current(microvolts drop, std::uint32_t shunt_mohm)
+{
+	return milliamps(drop.count() / (std::int32_t)shunt_mohm);
+}
+
+enum class channel : unsigned int {
+	temp1 = LTC2990_CHAN_TEMP1,
+	temp2 = LTC2990_CHAN_TEMP2,
+	temp3 = LTC2990_CHAN_TEMP3,
+	curr1 = LTC2990_CHAN_CURR1,
+	curr2 = LTC2990_CHAN_CURR2,
+	in0 = LTC2990_CHAN_IN0,
+	in1 = LTC2990_CHAN_IN1,
+	in2 = LTC2990_CHAN_IN2,
+	in3 = LTC2990_CHAN_IN3,
+	in4 = LTC2990_CHAN_IN4,
+};
+
+/* Unit of each channel, used by snapshot_view::get() */
+template <channel C> struct channel_unit { typedef millivolts type; };
+template <> struct channel_unit<channel::temp1> { typedef millidegrees type; };
+template <> struct channel_unit<channel::temp2> { typedef millidegrees type; };
+template <> struct channel_unit<channel::temp3> { typedef millidegrees type; };
+template <> struct channel_unit<channel::curr1> { typedef microvolts type; };
+template <> struct channel_unit<channel::curr2> { typedef microvolts type; };
+
+/*
+ * Read-only view of one struct ltc2990_snapshot. It does not own the
+ * snapshot, which must outlive it. Invalid channels read as zero; check
+ * valid() where the measurement mode is not known.
+ */
+class snapshot_view {
+public:
+	explicit snapshot_view(const struct ltc2990_snapshot &s) : s_(&s) {}
+
+	unsigned int adapter() const { return s_->adapter; }
+	unsigned int addr() const { return s_->addr; }
+	unsigned int mode() const { return s_->mode; }
+	std::uint64_t timestamp_ns() const { return s_->timestamp; }
+
+	bool valid(channel c) const
+	{
+		return s_->valid & (1u << static_cast<unsigned int>(c));
+	}
+
+	template <channel C>
+	typename channel_unit<C>::type get() const
+	{
+		return typename channel_unit<C>::type(raw(C));
+	}
+
+	/* temp1 is the die, temp2 and temp3 the remote sensors */
+	millidegrees temp(unsigned int n) const
+	{
+		return millidegrees(raw(LTC2990_CHAN_TEMP1 + n - 1));
+	}
+
+	/* Differential voltage V1-V2 (n = 1) or V3-V4 (n = 2) */
+	microvolts curr(unsigned int n) const
+	{
+		return microvolts(raw(LTC2990_CHAN_CURR1 + n - 1));
+	}
+
+	/* in0 is Vcc, in1 to in4 are V1 to V4 */
+	millivolts in(unsigned int n) const
+	{
+		return millivolts(raw(LTC2990_CHAN_IN0 + n));
+	}
+
+	const struct ltc2990_snapshot &raw_snapshot() const { return *s_; }
+
+private:
+	std::int32_t raw(channel c) const
+	{
+		return raw(static_cast<unsigned int>(c));
+	}
+
+	std::int32_t raw(unsigned int ch) const
+	{
+		return ch < LTC2990_CHAN_COUNT ? s_->value[ch] : 0;
+	}
+
+	const struct ltc2990_snapshot *s_;
+};
+
+/* Forward iterator yielding snapshot_view over a snapshot array */
+class snapshot_iterator {
+public:
+	explicit snapshot_iterator(const struct ltc2990_snapshot *p) : p_(p) {}
+
+	snapshot_view operator*() const { return snapshot_view(*p_); }
+	snapshot_iterator &operator++() { ++p_; return *this; }
+	bool operator!=(const snapshot_iterator &o) const { return p_ != o.p_; }
+	bool operator==(const snapshot_iterator &o) const { return p_ == o.p_; }
+
+private:
+	const struct ltc2990_snapshot *p_;
+};
+
+/*
+ * All bound devices through LTC2990_IOC_SNAPSHOT. The snapshot array only
+ * grows when more devices are bound than it has room for, so steady state
+ * refreshes are one ioctl and no allocation.
+ */
+class snapshot_reader {
+public:
+	explicit snapshot_reader(std::size_t capacity = 16)
+		: fd_(-1), count_(0), snaps_(capacity ? capacity : 1) {}
+	~snapshot_reader() { close(); }
+
+	snapshot_reader(const snapshot_reader &) = delete;
+	snapshot_reader &operator=(const snapshot_reader &) = delete;
+
+	int open(const char *dev = "/dev/ltc2990")
+	{
+		close();
+		fd_ = ::open(dev, O_RDONLY | O_CLOEXEC);
+		return fd_ < 0 ? -errno : 0;
+	}
+
+	void close()
+	{
+		if (fd_ >= 0)
+			::close(fd_);
+		fd_ = -1;
+		count_ = 0;
+	}
+
+	/* Take a new snapshot of every device, 0 or a negative error */
+	int refresh()
+	{
+		struct ltc2990_snapshot_req req;
+
+		for (;;) {
+			memset(&req, 0, sizeof(req));
+			req.count = snaps_.size();
+			req.snapshots = (std::uintptr_t)snaps_.data();
+			if (ioctl(fd_, LTC2990_IOC_SNAPSHOT, &req) < 0)
+				return -errno;
+			if (req.total <= snaps_.size())
+				break;
+			/* a device was bound since the last refresh */
+			snaps_.resize(req.total);
+		}
+
+		count_ = req.count;
+		return 0;
+	}
+
+	std::size_t size() const { return count_; }
+	snapshot_view operator[](std::size_t i) const
+	{
+		return snapshot_view(snaps_[i]);
+	}
+
+	snapshot_iterator begin() const
+	{
+		return snapshot_iterator(snaps_.data());
+	}
+	snapshot_iterator end() const
+	{
+		return snapshot_iterator(snaps_.data() + count_);
+	}
+
+	/* Index of the device at adapter-addr, or -1 */
+	int find(unsigned int adapter, unsigned int addr) const
+	{
+		for (std::size_t i = 0; i < count_; i++)
+			if (snaps_[i].adapter == adapter && snaps_[i].addr == addr)
+				return i;
+		return -1;
+	}
+
+	int fd() const { return fd_; }
+
+private:
+	int fd_;
+	std::size_t count_;
+	std::vector<struct ltc2990_snapshot> snaps_;
+};
+
+/*
+ * Sampler scans published on the "samples" multicast group. Batches are
+ * parsed in place in the receive buffer; the views passed to the callback
+ * are only valid until it returns.
+ */
+class multicast_reader {
+public:
+	explicit multicast_reader(std::size_t bufsize = 65536)
+		: fd_(-1), buf_(bufsize / sizeof(std::uint64_t) + 1) {}
+	~multicast_reader() { close(); }
+
+	multicast_reader(const multicast_reader &) = delete;
+	multicast_reader &operator=(const multicast_reader &) = delete;
+
+	int open()
+	{
+		close();
+		fd_ = ltc2990_genl_subscribe(buf(), bufsize());
+		return fd_ < 0 ? fd_ : 0;
+	}
+
+	void close()
+	{
+		if (fd_ >= 0)
+			::close(fd_);
+		fd_ = -1;
+	}
+
+	/*
+	 * Receive one datagram and call fn(snapshot_view) for every snapshot
+	 * in it. Returns the number of snapshots or a negative error; -ENOBUFS
+	 * means batches were dropped because the socket was not read in time.
+	 */
+	template <typename Fn>
+	int poll(Fn &&fn, int flags = 0)
+	{
+		const struct ltc2990_snapshot *snaps;
+		struct nlmsghdr *n;
+		unsigned int count, i;
+		int len, total = 0;
+
+		len = recv(fd_, buf(), bufsize(), flags);
+		if (len < 0)
+			return -errno;
+
+		for (n = (struct nlmsghdr *)buf(); NLMSG_OK(n, (unsigned int)len);
+		     n = NLMSG_NEXT(n, len)) {
+			snaps = ltc2990_genl_snapshots(n, &count);
+			for (i = 0; i < count; i++)
+				fn(snapshot_view(snaps[i]));
+			total += count;
+		}
+
+		return total;
+	}
+
+	int fd() const { return fd_; }
+
+private:
+	char *buf() { return reinterpret_cast<char *>(buf_.data()); }
+	std::size_t bufsize() const { return buf_.size() * sizeof(std::uint64_t); }
+
+	int fd_;
+	/* u64 elements keep the snapshots 8-byte aligned */
+	std::vector<std::uint64_t> buf_;
+};
+
+/* An LTC2990 registered with hwmon */
+struct hwmon_device {
+	std::string path;	/* /sys/class/hwmon/hwmonN */
+	std::string device;	/* I2C device name, "adapter-addr" */
+};
+
+/*
+ * Find the LTC2990 hwmon devices. This allocates and is meant for setup;
+ * use the readers above for the samples themselves.
+ */
+inline std::vector<hwmon_device> discover(const char *root = "/sys/class/hwmon")
+{
+	std::vector<hwmon_device> devs;
+	struct dirent *de;
+	char name[32], link[256];
+	DIR *dir;
+
+	dir = opendir(root);
+	if (!dir)
+		return devs;
+
+	while ((de = readdir(dir))) {
+		std::string path = std::string(root) + "/" + de->d_name;
+		FILE *f;
+		ssize_t len;
+
+		if (de->d_name[0] == '.')
+			continue;
+		f = fopen((path + "/name").c_str(), "r");
+		if (!f)
+			continue;
+		if (!fgets(name, sizeof(name), f))
+			name[0] = '\0';
+		fclose(f);
+		if (strcmp(name, "ltc2990\n"))
+			continue;
+
+		hwmon_device d;
+		d.path = path;
+		len = readlink((path + "/device").c_str(), link, sizeof(link) - 1);
+		if (len > 0) {
+			link[len] = '\0';
+			d.device = strrchr(link, '/') ? strrchr(link, '/') + 1 : link;
+		}
+		devs.push_back(d);
+	}
+
+	closedir(dir);
+	return devs;
+}
+
+} /* namespace ltc2990 */
+
+#endif /* LTC2990_CLIENT_HPP */
@@ -0,0 +1,65 @@
+#!/bin/sh
+#
+# ltc2990-contention.sh: latency of other bus traffic under LTC2990 sampling
+#
+# Copyright (C) 2014 Topic Embedded Products
+#
+# License: GPLv2
+#
+# Usage: ltc2990-contention.sh [devices] [delay_us] [interval ms] [reads]
+#
+# Puts the given number of emulated chips (default 16) on one emulated
+# adapter with delay_us latency per transaction (default 200). It then
+# runs ltc2990-buslat against the first chip, standing in for latency
+# critical traffic on the same bus. The measurement is repeated with:
+#   off       no sampler
+#   normal    the sampler refreshing every interval ms (default 20)
+#   lowprio   the same, refreshes giving way to other bus users
+#   budget    lowprio, and at most 10% of the bus per 100 ms
+# For each it reports the buslat percentiles and the sampler's scans,
+# deferrals and throttles. Must be run as root with debugfs mounted and
+# i2c-dev available, from the directory holding ltc2990-buslat.
+
+set -e
+
+N=${1:-16}
+DELAY=${2:-200}
+INTERVAL=${3:-20}
+READS=${4:-5000}
+DBG=/sys/kernel/debug/ltc2990/sampler
+
+field() {
+	awk -v k="$1:" '$1 == k { print $2 }' "$DBG"
+}
+
+modprobe i2c-dev
+modprobe ltc2990-emu devices="$N" per_bus="$N" delay_us="$DELAY"
+trap 'rmmod ltc2990 2>/dev/null; rmmod ltc2990-emu' EXIT
+
+bus=$(grep -l '^ltc2990-emu 0$' /sys/bus/i2c/devices/i2c-*/name | head -1)
+bus=$(basename "$(dirname "$bus")")
+bus=${bus#i2c-}
+
+while read -r name params; do
+	rmmod ltc2990 2>/dev/null || true
+	# shellcheck disable=SC2086
+	modprobe ltc2990 $params
+	sleep 1
+	scans=$(field scans)
+	deferrals=$(field deferrals)
+	throttles=$(field throttles)
+
+	echo "$name: $params"
+	./ltc2990-buslat -n "$READS" "$bus" 0x08 |
+		awk '$1 ~ /^(errors|p50|p99|p999|max):$/ { printf "  %s\t%s %s\n", $1, $2, $3 }'
+	if [ -n "$scans" ]; then
+		echo "  scans:\t$(($(field scans) - scans))"
+		echo "  deferrals:\t$(($(field deferrals) - deferrals))"
+		echo "  throttles:\t$(($(field throttles) - throttles))"
+	fi
+done <<EOT
+off sample_interval=0
+normal sample_interval=$INTERVAL
+lowprio sample_interval=$INTERVAL lowprio=1
+budget sample_interval=$INTERVAL lowprio=1 bus_budget_us=10000 bus_window_ms=100
+EOT
@@ -0,0 +1,217 @@
+/*
+ * ltc2990-cxxbench: binary client views against sysfs text parsing
+ *
+ * Copyright (C) 2014 Topic Embedded Products
+ *
+ * License: GPLv2
+ *
+ * Reads all channels of all LTC2990 devices the requested number of times,
+ * once by pread and strtol of every hwmon *_input attribute and once
+ * through ltc2990-client.hpp, and reports the cost per channel value and
+ * the heap allocations made inside the timed loops:
+ *
+ *   ltc2990-cxxbench [-n rounds]
+ *
+ * Both loops fold the values into a checksum so neither can be optimised
+ * away. With a cache timeout in effect both mostly measure cached reads;
+ * set it to zero to include the bus transfers.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <time.h>
+
+#include "ltc2990-client.hpp"
+
+static unsigned long allocations;
+
+void *operator new(std::size_t size)
+{
+	void *p;
+
+	allocations++;
+	p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+	free(p);
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+struct result {
+	unsigned long long ns;
+	unsigned long values;
+	unsigned long errors;
+	unsigned long allocations;
+	long long checksum;
+};
+
+static void print(const char *name, const struct result &r)
+{
+	printf("%s:\tvalues %lu\terrors %lu\t%.1f ns/value\tallocations %lu\t"
+	       "checksum %lld\n", name, r.values, r.errors,
+	       r.values ? (double)r.ns / r.values : 0.0, r.allocations,
+	       r.checksum);
+}
+
+static int bench_text(const std::vector<ltc2990::hwmon_device> &devs,
+		      unsigned long rounds, struct result &r)
+{
+	std::vector<int> fds;
+	struct dirent *de;
+	unsigned long i;
+	char val[32];
+	DIR *dir;
+
+	for (const auto &d : devs) {
+		dir = opendir(d.path.c_str());
+		if (!dir)
+			continue;
+		while ((de = readdir(dir))) {
+			std::string name(de->d_name);
+
+			if (name.size() < 6 ||
+			    name.compare(name.size() - 6, 6, "_input"))
+				continue;
+			int fd = open((d.path + "/" + name).c_str(), O_RDONLY);
+			if (fd >= 0)
+				fds.push_back(fd);
+		}
+		closedir(dir);
+	}
+	if (fds.empty())
+		return -ENODEV;
+
+	r.allocations = allocations;
+	r.ns = now_ns();
+	for (i = 0; i < rounds; i++) {
+		for (int fd : fds) {
+			ssize_t len = pread(fd, val, sizeof(val) - 1, 0);
+
+			/* inactive channels fail with ENODATA */
+			if (len < 0) {
+				r.errors++;
+				continue;
+			}
+			val[len] = '\0';
+			r.checksum += strtol(val, NULL, 10);
+			r.values++;
+		}
+	}
+	r.ns = now_ns() - r.ns;
+	r.allocations = allocations - r.allocations;
+
+	for (int fd : fds)
+		close(fd);
+	return 0;
+}
+
+static int bench_binary(unsigned long rounds, struct result &r)
+{
+	ltc2990::snapshot_reader reader;
+	unsigned long i;
+	unsigned int ch;
+	int ret;
+
+	ret = reader.open();
+	if (!ret)
+		ret = reader.refresh();
+	if (ret)
+		return ret;
+
+	r.allocations = allocations;
+	r.ns = now_ns();
+	for (i = 0; i < rounds; i++) {
+		if (reader.refresh()) {
+			r.errors++;
+			continue;
+		}
+		for (auto s : reader) {
+			for (ch = 1; ch <= 3; ch++)
+				if (s.valid(ltc2990::channel(LTC2990_CHAN_TEMP1 + ch - 1))) {
+					r.checksum += s.temp(ch).count();
+					r.values++;
+				}
+			for (ch = 1; ch <= 2; ch++)
+				if (s.valid(ltc2990::channel(LTC2990_CHAN_CURR1 + ch - 1))) {
+					r.checksum += s.curr(ch).count();
+					r.values++;
+				}
+			for (ch = 0; ch <= 4; ch++)
+				if (s.valid(ltc2990::channel(LTC2990_CHAN_IN0 + ch))) {
+					r.checksum += s.in(ch).count();
+					r.values++;
+				}
+		}
+	}
+	r.ns = now_ns() - r.ns;
+	r.allocations = allocations - r.allocations;
+
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-n rounds]\n", name);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	std::vector<ltc2990::hwmon_device> devs;
+	struct result text = {}, binary = {};
+	unsigned long rounds = 10000;
+	int opt, ret;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+		case 'n':
+			rounds = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc || !rounds)
+		usage(argv[0]);
+
+	devs = ltc2990::discover();
+	printf("devices:\t%zu\n", devs.size());
+	for (const auto &d : devs)
+		printf("\t%s\t%s\n", d.path.c_str(), d.device.c_str());
+
+	ret = bench_text(devs, rounds, text);
+	if (ret)
+		fprintf(stderr, "text: %s\n", strerror(-ret));
+	else
+		print("text", text);
+
+	ret = bench_binary(rounds, binary);
+	if (ret)
+		fprintf(stderr, "binary: %s\n", strerror(-ret));
+	else
+		print("binary", binary);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,418 @@
+/*
+ * ltc2990-exporter: serve LTC2990 measurements as OpenMetrics text
+ *
+ * Copyright (C) 2014 Topic Embedded Products
+ *
+ * License: GPLv2
+ *
+ * Keeps the latest snapshot of every bound LTC2990 and serves it as
+ * OpenMetrics text on a Unix stream socket. Each connection receives the
+ * whole exposition and is closed, so a scrape is:
+ *
+ *   socat - UNIX-CONNECT:/run/ltc2990.sock
+ *
+ * Snapshots come from polling /dev/ltc2990 every interval, or with -m
+ * from the sampler's netlink multicast. Every channel of every device has
+ * its own pre-rendered line that is only formatted again when its value
+ * changes. The exposition is reassembled from these lines at the first
+ * scrape after a change; other scrapes send the previous one as is.
+ * Clients are served one at a time, so one that does not take the whole
+ * exposition within SEND_TIMEOUT_MS is dropped rather than stalling the
+ * updates.
+ *
+ *   ltc2990-exporter [-i interval_ms] [-m] [-s socket]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ltc2990-conv.h"
+#include "ltc2990-genl.h"
+
+#define MAX_DEVICES	1024
+#define LINE_SIZE	96
+
+/* Time a client gets to take the whole exposition */
+#define SEND_TIMEOUT_MS	100
+
+/* Metric families, each sample line sits below its family's header */
+enum family {
+	FAM_TEMP,
+	FAM_SHUNT,
+	FAM_VOLTAGE,
+	FAM_COUNT
+};
+
+static const char *const fam_headers[FAM_COUNT] = {
+	"# TYPE ltc2990_temperature_celsius gauge\n"
+	"# HELP ltc2990_temperature_celsius Die and remote sensor temperature.\n",
+	"# TYPE ltc2990_shunt_voltage_volts gauge\n"
+	"# HELP ltc2990_shunt_voltage_volts Differential input voltage.\n",
+	"# TYPE ltc2990_voltage_volts gauge\n"
+	"# HELP ltc2990_voltage_volts Single ended input and supply voltage.\n",
+};
+
+/* Metric, family and driver units per base unit of each conversion */
+#define METRIC_TEMP	"ltc2990_temperature_celsius", FAM_TEMP, 1000
+#define METRIC_DIFF	"ltc2990_shunt_voltage_volts", FAM_SHUNT, 1000000
+#define METRIC_SINGLE	"ltc2990_voltage_volts", FAM_VOLTAGE, 1000
+#define METRIC_VCC	METRIC_SINGLE
+
+#define CHAN(_id, _name, _index, _reg, _conv)	\
+	[LTC2990_##_id] = { #_name, METRIC_##_conv },
+
+/* snapshots follow the uapi channel order, which is the driver's */
+_Static_assert((int)LTC2990_NUM_CHANNELS == LTC2990_CHAN_COUNT &&
+	       (int)LTC2990_CURR1 == LTC2990_CHAN_CURR1 &&
+	       (int)LTC2990_IN4 == LTC2990_CHAN_IN4, "channel tables differ");
+
+static const struct {
+	const char *name;
+	const char *metric;
+	enum family fam;
+	int scale;
+} chans[LTC2990_CHAN_COUNT] = {
+	LTC2990_CHANNELS(CHAN)
+};
+
+struct device {
+	struct ltc2990_snapshot snap;
+	unsigned char len[LTC2990_CHAN_COUNT];
+	char line[LTC2990_CHAN_COUNT][LINE_SIZE];
+};
+
+static struct device devs[MAX_DEVICES];
+static unsigned int nr_devs;
+static struct ltc2990_snapshot snaps[MAX_DEVICES];
+
+static char *out;
+static size_t out_len;
+static int dirty = 1;
+
+static unsigned long renders, scrapes, dropped;
+static volatile sig_atomic_t stop;
+
+static char buf[65536] __attribute__((aligned(8)));
+
+static void render(struct device *d, unsigned int ch)
+{
+	int v = d->snap.value[ch], scale = chans[ch].scale;
+	unsigned int a = v < 0 ? -(unsigned int)v : (unsigned int)v;
+	int len;
+
+	len = snprintf(d->line[ch], LINE_SIZE,
+		       "%s{device=\"%u-%04x\",channel=\"%s\"} %s%u.%0*u\n",
+		       chans[ch].metric, d->snap.adapter, d->snap.addr,
+		       chans[ch].name, v < 0 ? "-" : "", a / scale,
+		       scale == 1000 ? 3 : 6, a % scale);
+	d->len[ch] = len < LINE_SIZE ? len : 0;
+	renders++;
+}
+
+/* Take a new snapshot for device i, render the lines that changed */
+static void update(unsigned int i, const struct ltc2990_snapshot *s)
+{
+	struct ltc2990_snapshot old;
+	struct device *d;
+	unsigned int ch, bit;
+	int moved;
+
+	if (i >= MAX_DEVICES)
+		return;
+	d = &devs[i];
+	old = d->snap;
+	d->snap = *s;
+
+	moved = i >= nr_devs || old.adapter != s->adapter ||
+		old.addr != s->addr;
+	for (ch = 0; ch < LTC2990_CHAN_COUNT; ch++) {
+		bit = 1u << ch;
+		if (!moved && (old.valid & bit) == (s->valid & bit) &&
+		    (!(s->valid & bit) || old.value[ch] == s->value[ch]))
+			continue;
+		if (s->valid & bit)
+			render(d, ch);
+		dirty = 1;
+	}
+}
+
+static void resize(unsigned int total)
+{
+	if (total > MAX_DEVICES)
+		total = MAX_DEVICES;
+	if (total != nr_devs)
+		dirty = 1;
+	nr_devs = total;
+}
+
+/* Concatenate the family headers and the pre-rendered lines */
+static int assemble(void)
+{
+	static size_t size;
+	unsigned int f, i, ch;
+	size_t need, pos = 0;
+
+	need = sizeof("# EOF\n");
+	for (f = 0; f < FAM_COUNT; f++)
+		need += strlen(fam_headers[f]);
+	need += (size_t)nr_devs * LTC2990_CHAN_COUNT * LINE_SIZE;
+	if (need > size) {
+		char *p = realloc(out, need);
+
+		if (!p)
+			return -ENOMEM;
+		out = p;
+		size = need;
+	}
+
+	for (f = 0; f < FAM_COUNT; f++) {
+		memcpy(out + pos, fam_headers[f], strlen(fam_headers[f]));
+		pos += strlen(fam_headers[f]);
+		for (i = 0; i < nr_devs; i++) {
+			const struct device *d = &devs[i];
+
+			for (ch = 0; ch < LTC2990_CHAN_COUNT; ch++) {
+				if (chans[ch].fam != f ||
+				    !(d->snap.valid & (1u << ch)))
+					continue;
+				memcpy(out + pos, d->line[ch], d->len[ch]);
+				pos += d->len[ch];
+			}
+		}
+	}
+	memcpy(out + pos, "# EOF\n", 6);
+	out_len = pos + 6;
+	dirty = 0;
+
+	return 0;
+}
+
+static int poll_ioctl(int fd)
+{
+	struct ltc2990_snapshot_req req;
+	unsigned int i;
+
+	memset(&req, 0, sizeof(req));
+	req.count = MAX_DEVICES;
+	req.snapshots = (uintptr_t)snaps;
+	if (ioctl(fd, LTC2990_IOC_SNAPSHOT, &req) < 0)
+		return -errno;
+
+	for (i = 0; i < req.count; i++)
+		update(i, &snaps[i]);
+	resize(req.count);
+
+	return 0;
+}
+
+static int recv_netlink(int fd)
+{
+	const struct ltc2990_snapshot *s;
+	unsigned int first, total, count, i;
+	struct nlmsghdr *n;
+	struct nlattr *a;
+	int len, rem;
+
+	len = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+	if (len < 0)
+		return errno == EAGAIN || errno == ENOBUFS ? 0 : -errno;
+
+	for (n = (struct nlmsghdr *)buf; NLMSG_OK(n, (unsigned int)len);
+	     n = NLMSG_NEXT(n, len)) {
+		s = ltc2990_genl_snapshots(n, &count);
+		if (!s)
+			continue;
+		first = total = 0;
+		rem = n->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+		for (a = GENL_ATTRS(n); NLA_OK(a, rem); a = NLA_NEXT(a, rem)) {
+			if (a->nla_type == LTC2990_ATTR_FIRST)
+				first = *(__u32 *)NLA_DATA(a);
+			else if (a->nla_type == LTC2990_ATTR_TOTAL)
+				total = *(__u32 *)NLA_DATA(a);
+		}
+		for (i = 0; i < count; i++)
+			update(first + i, &s[i]);
+		resize(total);
+	}
+
+	return 0;
+}
+
+static long long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static void serve(int lfd)
+{
+	struct timeval tv = { .tv_usec = SEND_TIMEOUT_MS * 1000 };
+	long long end = now_ms() + SEND_TIMEOUT_MS;
+	ssize_t ret = 0;
+	size_t pos;
+	int cfd;
+
+	cfd = accept4(lfd, NULL, NULL, SOCK_CLOEXEC);
+	if (cfd < 0)
+		return;
+
+	if ((dirty && assemble()) ||
+	    setsockopt(cfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) < 0) {
+		close(cfd);
+		return;
+	}
+	/* a trickling client must not get a fresh timeout for every send */
+	for (pos = 0; pos < out_len; pos += ret) {
+		if (now_ms() >= end)
+			break;
+		ret = send(cfd, out + pos, out_len - pos, MSG_NOSIGNAL);
+		if (ret <= 0)
+			break;
+	}
+	close(cfd);
+	if (pos < out_len)
+		dropped++;
+	else
+		scrapes++;
+}
+
+static int listen_unix(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return -ENAMETOOLONG;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -errno;
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    listen(fd, 16) < 0) {
+		int err = -errno;
+
+		close(fd);
+		return err;
+	}
+
+	return fd;
+}
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-i interval_ms] [-m] [-s socket]\n", name);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = "/run/ltc2990.sock";
+	struct itimerspec its;
+	struct pollfd pfd[2];
+	long interval = 1000;
+	int multicast = 0;
+	int opt, src, ret;
+	uint64_t ticks;
+
+	while ((opt = getopt(argc, argv, "i:ms:")) != -1) {
+		switch (opt) {
+		case 'i':
+			interval = strtol(optarg, NULL, 0);
+			break;
+		case 'm':
+			multicast = 1;
+			break;
+		case 's':
+			path = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc || interval <= 0)
+		usage(argv[0]);
+
+	if (multicast) {
+		src = ltc2990_genl_subscribe(buf, sizeof(buf));
+		if (src < 0) {
+			fprintf(stderr, "%s: %s\n", LTC2990_GENL_NAME,
+				strerror(-src));
+			return EXIT_FAILURE;
+		}
+		pfd[1].fd = src;
+	} else {
+		src = open("/dev/ltc2990", O_RDONLY | O_CLOEXEC);
+		if (src < 0 || (ret = poll_ioctl(src)) < 0) {
+			perror("/dev/ltc2990");
+			return EXIT_FAILURE;
+		}
+		pfd[1].fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+		its.it_interval.tv_sec = interval / 1000;
+		its.it_interval.tv_nsec = interval % 1000 * 1000000;
+		its.it_value = its.it_interval;
+		if (pfd[1].fd < 0 ||
+		    timerfd_settime(pfd[1].fd, 0, &its, NULL) < 0) {
+			perror("timerfd");
+			return EXIT_FAILURE;
+		}
+	}
+
+	pfd[0].fd = listen_unix(path);
+	if (pfd[0].fd < 0) {
+		fprintf(stderr, "%s: %s\n", path, strerror(-pfd[0].fd));
+		return EXIT_FAILURE;
+	}
+	pfd[0].events = pfd[1].events = POLLIN;
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	while (!stop) {
+		if (poll(pfd, 2, -1) < 0)
+			continue;
+		if (pfd[1].revents & POLLIN) {
+			if (multicast) {
+				ret = recv_netlink(src);
+			} else {
+				if (read(pfd[1].fd, &ticks, sizeof(ticks)) < 0)
+					continue;
+				ret = poll_ioctl(src);
+			}
+			if (ret < 0)
+				fprintf(stderr, "update: %s\n", strerror(-ret));
+		}
+		if (pfd[0].revents & POLLIN)
+			serve(pfd[0].fd);
+	}
+
+	fprintf(stderr, "%lu scrapes, %lu clients dropped, %lu line renders\n",
+		scrapes, dropped, renders);
+	unlink(path);
+	free(out);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,74 @@
+#!/bin/sh
+#
+# ltc2990-faultbench.sh: read latency of an LTC2990 under bus faults
+#
+# Copyright (C) 2014 Topic Embedded Products
+#
+# License: GPLv2
+#
+# Usage: ltc2990-faultbench.sh [profiles] [reads]
+#
+# Binds one emulated chip and, for every fault profile in the given file
+# (one per line, '#' starts a comment) or a built in set, measures the
+# read latency of curr1_input with ltc2990-readbench and reports the
+# percentiles seen by userspace next to those the driver recorded for
+# ltc2990_show_value() itself. The cache is kept at its minimum age so
+# the bus is hit as often as the driver allows. Must be run as root with
+# debugfs mounted, from the directory holding ltc2990-readbench.
+
+set -e
+
+PROFILES=${1:-}
+READS=${2:-20000}
+EMU=/sys/module/ltc2990_emu/parameters
+DBG=/sys/kernel/debug/ltc2990
+
+builtin_profiles() {
+	cat <<-EOT
+	delay=none
+	delay=fixed:100
+	delay=uniform:50:500
+	delay=exp:200
+	delay=bimodal:100:20000:1000
+	delay=fixed:100 nak=10000
+	delay=fixed:100 corrupt=10000
+	delay=fixed:100 stuck=1000:200
+	EOT
+}
+
+modprobe ltc2990 sample_interval=0
+modprobe ltc2990-emu devices=1
+trap 'echo > "$EMU/profile"; rmmod ltc2990-emu' EXIT
+
+hwmon=$(dirname "$(grep -l '^ltc2990$' /sys/class/hwmon/*/name | head -1)")
+dev=$(basename "$(readlink -f "$hwmon/device")")
+echo 50 > "$hwmon/update_interval"
+echo Y > "$DBG/instrumentation"
+
+stat() {
+	awk -v k="$1:" '$1 == k { print $NF }' "$DBG/$dev/stats"
+}
+
+if [ -n "$PROFILES" ]; then
+	grep -v '^[[:space:]]*\(#\|$\)' "$PROFILES"
+else
+	builtin_profiles
+fi | while read -r profile; do
+	echo "$profile" > "$EMU/profile"
+	echo 0 > "$EMU/naks"
+	echo 0 > "$EMU/corruptions"
+	echo 0 > "$EMU/stalls"
+	echo > "$DBG/$dev/stats"
+
+	./ltc2990-readbench -n "$READS" "$hwmon/curr1_input" > /tmp/faultbench.$$
+
+	echo "profile: $profile"
+	awk '$1 ~ /^(errors|p50|p99|p999):$/ { printf "  user_%s\t%s %s\n", $1, $2, $3 }' \
+		/tmp/faultbench.$$
+	echo "  driver_p50:\t< $(stat p50_ns) ns"
+	echo "  driver_p99:\t< $(stat p99_ns) ns"
+	echo "  driver_p999:\t< $(stat p999_ns) ns"
+	echo "  injected:\tnaks $(cat "$EMU/naks") corruptions $(cat "$EMU/corruptions") stalls $(cat "$EMU/stalls")"
+done
+
+rm -f /tmp/faultbench.$$
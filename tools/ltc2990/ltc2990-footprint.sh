@@ -0,0 +1,55 @@
+#!/bin/sh
+#
+# ltc2990-footprint.sh: measure the kernel memory cost per LTC2990 device
+#
+# Copyright (C) 2014 Topic Embedded Products
+#
+# License: GPLv2
+#
+# Usage: ltc2990-footprint.sh [devices] [per_bus]
+#
+# Loads ltc2990-emu without clients, then binds the requested number of
+# emulated chips through new_device and reports the growth of slab and
+# per-cpu memory divided by the number of devices. This covers everything
+# a device costs: the i2c client, driver state, hwmon device and the
+# sysfs/debugfs nodes. Must be run as root with both modules installed.
+
+set -e
+
+N=${1:-100}
+PER_BUS=${2:-4}
+
+meminfo() {
+	awk '$1 == "Slab:" || $1 == "Percpu:" { kb += $2 } END { print kb }' \
+		/proc/meminfo
+}
+
+modprobe ltc2990
+modprobe ltc2990-emu devices="$N" per_bus="$PER_BUS" clients=0
+trap 'rmmod ltc2990-emu' EXIT
+
+sleep 1
+before=$(meminfo)
+
+for adap in /sys/bus/i2c/devices/i2c-*; do
+	grep -q '^ltc2990-emu ' "$adap/name" || continue
+	nr=$(cat "$adap/name")
+	nr=${nr#ltc2990-emu }
+	chips=$((N - nr * PER_BUS))
+	[ "$chips" -gt "$PER_BUS" ] && chips=$PER_BUS
+	i=0
+	while [ "$i" -lt "$chips" ]; do
+		printf 'ltc2990 0x%02x\n' $((0x08 + i)) > "$adap/new_device"
+		i=$((i + 1))
+	done
+done
+
+sleep 1
+after=$(meminfo)
+
+echo "devices:        $N"
+echo "total_kb:       $((after - before))"
+echo "per_device_b:   $(((after - before) * 1024 / N))"
+if [ -r /sys/kernel/debug/ltc2990/footprint ]; then
+	cat /sys/kernel/debug/ltc2990/footprint
+fi
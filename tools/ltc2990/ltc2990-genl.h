@@ -0,0 +1,150 @@
+/*
+ * Generic netlink helpers shared by the LTC2990 tools
+ *
+ * Copyright (C) 2014 Topic Embedded Products
+ *
+ * License: GPLv2
+ *
+ * Plain C that also builds as C++, for ltc2990-client.hpp.
+ */
+
+#ifndef LTC2990_GENL_H
+#define LTC2990_GENL_H
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <linux/genetlink.h>
+#include <linux/ltc2990.h>
+#include <linux/netlink.h>
+
+#define GENL_ATTRS(g)	((struct nlattr *)((char *)NLMSG_DATA(g) + GENL_HDRLEN))
+#define NLA_OK(a, rem)	((rem) >= (int)sizeof(*(a)) && \
+			 (a)->nla_len >= sizeof(*(a)) && (a)->nla_len <= (rem))
+#define NLA_NEXT(a, rem) ((rem) -= NLA_ALIGN((a)->nla_len), \
+			  (struct nlattr *)((char *)(a) + NLA_ALIGN((a)->nla_len)))
+#define NLA_DATA(a)	((void *)((char *)(a) + NLA_HDRLEN))
+
+/* Ask the generic netlink controller for the samples group id */
+static inline int ltc2990_genl_resolve(int fd, char *buf, size_t size)
+{
+	struct {
+		struct nlmsghdr n;
+		struct genlmsghdr g;
+		char attrs[64];
+	} req;
+	struct nlattr *a, *grp, *ga;
+	struct nlmsghdr *n;
+	int len, rem, grem, arem;
+
+	memset(&req, 0, sizeof(req));
+	req.n.nlmsg_type = GENL_ID_CTRL;
+	req.n.nlmsg_flags = NLM_F_REQUEST;
+	req.g.cmd = CTRL_CMD_GETFAMILY;
+	req.g.version = 1;
+	a = (struct nlattr *)req.attrs;
+	a->nla_type = CTRL_ATTR_FAMILY_NAME;
+	a->nla_len = NLA_HDRLEN + sizeof(LTC2990_GENL_NAME);
+	strcpy((char *)NLA_DATA(a), LTC2990_GENL_NAME);
+	req.n.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN) + NLA_ALIGN(a->nla_len);
+
+	if (send(fd, &req, req.n.nlmsg_len, 0) < 0)
+		return -errno;
+	len = recv(fd, buf, size, 0);
+	if (len < 0)
+		return -errno;
+
+	n = (struct nlmsghdr *)buf;
+	if (!NLMSG_OK(n, (unsigned int)len) || n->nlmsg_type == NLMSG_ERROR)
+		return -ENOENT;
+
+	rem = n->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+	for (a = GENL_ATTRS(n); NLA_OK(a, rem); a = NLA_NEXT(a, rem)) {
+		if ((a->nla_type & NLA_TYPE_MASK) != CTRL_ATTR_MCAST_GROUPS)
+			continue;
+		grem = a->nla_len - NLA_HDRLEN;
+		for (grp = (struct nlattr *)NLA_DATA(a); NLA_OK(grp, grem);
+		     grp = NLA_NEXT(grp, grem)) {
+			const char *name = NULL;
+			int id = -1;
+
+			arem = grp->nla_len - NLA_HDRLEN;
+			for (ga = (struct nlattr *)NLA_DATA(grp); NLA_OK(ga, arem);
+			     ga = NLA_NEXT(ga, arem)) {
+				if (ga->nla_type == CTRL_ATTR_MCAST_GRP_NAME)
+					name = (const char *)NLA_DATA(ga);
+				else if (ga->nla_type == CTRL_ATTR_MCAST_GRP_ID)
+					id = *(__u32 *)NLA_DATA(ga);
+			}
+			if (name && id >= 0 &&
+			    !strcmp(name, LTC2990_GENL_MCGRP_SAMPLES))
+				return id;
+		}
+	}
+
+	return -ENOENT;
+}
+
+/*
+ * Open a generic netlink socket subscribed to the samples group, returns
+ * the socket or a negative error.
+ */
+static inline int ltc2990_genl_subscribe(char *buf, size_t size)
+{
+	struct sockaddr_nl addr;
+	int fd, group, err;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+
+	fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_GENERIC);
+	if (fd < 0)
+		return -errno;
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+		goto err;
+
+	group = ltc2990_genl_resolve(fd, buf, size);
+	if (group < 0) {
+		close(fd);
+		return group;
+	}
+	if (setsockopt(fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &group,
+		       sizeof(group)) < 0)
+		goto err;
+
+	return fd;
+
+err:
+	err = -errno;
+	close(fd);
+	return err;
+}
+
+/*
+ * Snapshots carried by one LTC2990_CMD_SAMPLES message, NULL if it has
+ * none. *count is set to their number.
+ */
+static inline const struct ltc2990_snapshot *
+ltc2990_genl_snapshots(struct nlmsghdr *n, unsigned int *count)
+{
+	int rem = n->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+	struct nlattr *a;
+
+	*count = 0;
+	if (((struct genlmsghdr *)NLMSG_DATA(n))->cmd != LTC2990_CMD_SAMPLES)
+		return NULL;
+
+	for (a = GENL_ATTRS(n); NLA_OK(a, rem); a = NLA_NEXT(a, rem)) {
+		if (a->nla_type == LTC2990_ATTR_SNAPSHOTS) {
+			*count = (a->nla_len - NLA_HDRLEN) /
+				 sizeof(struct ltc2990_snapshot);
+			return (const struct ltc2990_snapshot *)NLA_DATA(a);
+		}
+	}
+
+	return NULL;
+}
+
+#endif /* LTC2990_GENL_H */
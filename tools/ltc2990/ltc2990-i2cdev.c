@@ -0,0 +1,249 @@
+/*
+ * ltc2990-i2cdev: read LTC2990 chips from userspace through i2c-dev
+ *
+ * Copyright (C) 2014 Topic Embedded Products
+ *
+ * License: GPLv2
+ *
+ * For systems that cannot load the driver. All chips on one bus are read
+ * through a single open /dev/i2c-N. Every chip is read with one combined
+ * transaction, a register pointer write followed by a repeated start read
+ * of the whole TINT_MSB..VCC_LSB block, and as many chips as the kernel
+ * allows are batched into each I2C_RDWR ioctl. Values are converted with
+ * the driver's own tables from drivers/hwmon/ltc2990-conv.h.
+ *
+ *   ltc2990-i2cdev [-m mode] [-n rounds] [-i ms] [-q] <bus> <addr>...
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#include "ltc2990-conv.h"
+
+/* Two messages per chip, pointer write and block read */
+#define CHIPS_PER_IOCTL	(I2C_RDWR_IOCTL_MAX_MSGS / 2)
+
+static const char *const chan_names[LTC2990_NUM_CHANNELS] = {
+	LTC2990_CHANNELS(LTC2990_CHAN_NAME)
+};
+
+struct chip {
+	__u16 addr;
+	u8 mode;
+	u8 buf[LTC2990_BLOCK_LEN];
+	int err;
+};
+
+static unsigned long ioctls;
+
+/*
+ * Read len bytes from register reg of n chips, batched. A failing chip
+ * aborts the whole transfer on most adapters, so a failed batch is
+ * retried one chip at a time to find out which chips failed.
+ */
+static void read_regs(int fd, struct chip *chips, int n, u8 reg,
+		      u8 (*bufs)[LTC2990_BLOCK_LEN], __u16 len)
+{
+	struct i2c_msg msgs[2 * CHIPS_PER_IOCTL];
+	struct i2c_rdwr_ioctl_data rdwr = { .msgs = msgs };
+	int i, j, k;
+
+	for (i = 0; i < n; i += CHIPS_PER_IOCTL) {
+		k = n - i < CHIPS_PER_IOCTL ? n - i : CHIPS_PER_IOCTL;
+
+		for (j = 0; j < k; j++) {
+			msgs[2 * j] = (struct i2c_msg) {
+				.addr = chips[i + j].addr,
+				.len = 1,
+				.buf = &reg,
+			};
+			msgs[2 * j + 1] = (struct i2c_msg) {
+				.addr = chips[i + j].addr,
+				.flags = I2C_M_RD,
+				.len = len,
+				.buf = bufs[i + j],
+			};
+			chips[i + j].err = 0;
+		}
+
+		rdwr.nmsgs = 2 * k;
+		ioctls++;
+		if (ioctl(fd, I2C_RDWR, &rdwr) >= 0)
+			continue;
+
+		for (j = 0; j < k; j++) {
+			rdwr.msgs = &msgs[2 * j];
+			rdwr.nmsgs = 2;
+			ioctls++;
+			if (ioctl(fd, I2C_RDWR, &rdwr) < 0)
+				chips[i + j].err = errno;
+		}
+		rdwr.msgs = msgs;
+	}
+}
+
+/* Write CONTROL and trigger a conversion on every chip in one ioctl each */
+static int set_mode(int fd, struct chip *chips, int n, u8 mode)
+{
+	u8 ctl[2] = { LTC2990_CONTROL, LTC2990_CONTROL_MEASURE_ALL | mode };
+	u8 trig[2] = { LTC2990_TRIGGER, 1 };
+	struct i2c_msg msgs[2];
+	struct i2c_rdwr_ioctl_data rdwr = { .msgs = msgs, .nmsgs = 2 };
+	int i;
+
+	for (i = 0; i < n; i++) {
+		msgs[0] = (struct i2c_msg) {
+			.addr = chips[i].addr, .len = 2, .buf = ctl,
+		};
+		msgs[1] = (struct i2c_msg) {
+			.addr = chips[i].addr, .len = 2, .buf = trig,
+		};
+		if (ioctl(fd, I2C_RDWR, &rdwr) < 0) {
+			fprintf(stderr, "0x%02x: %s\n", chips[i].addr,
+				strerror(errno));
+			return -1;
+		}
+		chips[i].mode = mode;
+	}
+
+	return 0;
+}
+
+static void print_chip(const struct chip *chip)
+{
+	unsigned long chans = ltc2990_mode_chans[chip->mode];
+	u16 raw[LTC2990_NUM_REGS];
+	int ch;
+
+	if (chip->err) {
+		printf("0x%02x error=%s\n", chip->addr, strerror(chip->err));
+		return;
+	}
+
+	ltc2990_unpack_block(chip->buf, raw);
+	printf("0x%02x mode=%u", chip->addr, chip->mode);
+	for (ch = 0; ch < LTC2990_NUM_CHANNELS; ch++) {
+		const struct ltc2990_chan *chan = &ltc2990_chans[ch];
+		u16 val = raw[LTC2990_REG_IDX(chan->reg)];
+
+		if (!(chans & BIT(ch)))
+			continue;
+		printf(" %s=%d%s", chan_names[ch], ltc2990_convert(chan, val),
+		       val & LTC2990_DATA_VALID ? "" : "?");
+	}
+	printf("\n");
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [-m mode] [-n rounds] [-i ms] [-q] <bus> <addr>...\n",
+		name);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long rounds = 1, interval = 0, r;
+	unsigned long long start, total = 0;
+	u8 (*bufs)[LTC2990_BLOCK_LEN];
+	int mode = -1, quiet = 0;
+	struct chip *chips;
+	char dev[32];
+	int fd, n, i, opt;
+
+	while ((opt = getopt(argc, argv, "m:n:i:q")) != -1) {
+		switch (opt) {
+		case 'm':
+			mode = strtol(optarg, NULL, 0);
+			if (mode < 0 || mode >= LTC2990_NUM_MODES)
+				usage(argv[0]);
+			break;
+		case 'n':
+			rounds = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			interval = strtoul(optarg, NULL, 0);
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind < 2)
+		usage(argv[0]);
+
+	snprintf(dev, sizeof(dev), "/dev/i2c-%s", argv[optind++]);
+	fd = open(dev, O_RDWR);
+	if (fd < 0) {
+		fprintf(stderr, "%s: %s\n", dev, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	n = argc - optind;
+	chips = calloc(n, sizeof(*chips));
+	bufs = calloc(n, sizeof(*bufs));
+	if (!chips || !bufs)
+		return EXIT_FAILURE;
+	for (i = 0; i < n; i++)
+		chips[i].addr = strtoul(argv[optind + i], NULL, 16);
+
+	if (mode >= 0) {
+		if (set_mode(fd, chips, n, mode))
+			return EXIT_FAILURE;
+	} else {
+		/* use whatever mode each chip is in */
+		read_regs(fd, chips, n, LTC2990_CONTROL, bufs, 1);
+		for (i = 0; i < n; i++) {
+			if (chips[i].err) {
+				fprintf(stderr, "0x%02x: CONTROL: %s\n",
+					chips[i].addr, strerror(chips[i].err));
+				return EXIT_FAILURE;
+			}
+			chips[i].mode = bufs[i][0] & LTC2990_CONTROL_MODE_MASK;
+		}
+	}
+
+	for (r = 0; r < rounds; r++) {
+		if (r && interval)
+			usleep(interval * 1000);
+
+		start = now_ns();
+		read_regs(fd, chips, n, LTC2990_TINT_MSB, bufs,
+			  LTC2990_BLOCK_LEN);
+		total += now_ns() - start;
+
+		for (i = 0; i < n; i++) {
+			memcpy(chips[i].buf, bufs[i], LTC2990_BLOCK_LEN);
+			if (!quiet)
+				print_chip(&chips[i]);
+		}
+	}
+
+	fprintf(stderr, "chips %d rounds %lu ioctls %lu mean_round_us %llu\n",
+		n, rounds, ioctls, rounds ? total / rounds / 1000 : 0);
+
+	free(bufs);
+	free(chips);
+	close(fd);
+	return EXIT_SUCCESS;
+}
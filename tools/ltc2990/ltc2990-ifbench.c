@@ -0,0 +1,320 @@
+/*
+ * ltc2990-ifbench: compare the LTC2990 acquisition interfaces
+ *
+ * Copyright (C) 2014 Topic Embedded Products
+ *
+ * License: GPLv2
+ *
+ * Acquires every active channel of every bound LTC2990 through one
+ * interface for a fixed time and prints a single JSON object with the
+ * sustained samples/s, CPU time, syscalls and latency per sample:
+ *
+ *   ltc2990-ifbench [-t seconds] sysfs|iio|ioctl|netlink
+ *
+ * sysfs   one pread of a hwmon *_input attribute per sample
+ * iio     one pread of an IIO in_*_input attribute per sample
+ * ioctl   LTC2990_IOC_SNAPSHOT on /dev/ltc2990, all devices per call
+ * netlink the sampler's multicast scans, one recv per message
+ *
+ * A sample is one channel value. For ioctl and netlink the latency is the
+ * age of the value, from the refresh that read it to its arrival here; for
+ * the attribute interfaces, which carry no timestamp, it is the duration
+ * of the read. CPU time is that of this process only, refreshes done by
+ * the sampler are not included.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ltc2990-genl.h"
+
+#define MAX_FILES	4096
+#define MAX_LATENCIES	(1 << 22)
+
+struct result {
+	unsigned long long samples;
+	unsigned long long syscalls;
+	unsigned long long errors;
+	unsigned long long *lat;
+	unsigned long nr_lat;
+};
+
+static char buf[65536] __attribute__((aligned(8)));
+
+static unsigned long long clock_ns(clockid_t clk)
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void add_latency(struct result *r, unsigned long long ns)
+{
+	if (r->nr_lat < MAX_LATENCIES)
+		r->lat[r->nr_lat++] = ns;
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int read_name(const char *dir, char *name, size_t len)
+{
+	char path[1024];
+	FILE *f;
+	int ret;
+
+	snprintf(path, sizeof(path), "%s/name", dir);
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	ret = fgets(name, len, f) ? 0 : -1;
+	fclose(f);
+	name[strcspn(name, "\n")] = 0;
+	return ret;
+}
+
+/* Open every *_input attribute of all devices named ltc2990 under class */
+static int open_inputs(const char *class, int *fds, int *nr_devices)
+{
+	struct dirent *de, *ae;
+	char dir[512], path[1024], name[32];
+	DIR *d, *a;
+	int n = 0;
+
+	*nr_devices = 0;
+	d = opendir(class);
+	if (!d)
+		return -errno;
+
+	while ((de = readdir(d))) {
+		if (de->d_name[0] == '.')
+			continue;
+		snprintf(dir, sizeof(dir), "%s/%s", class, de->d_name);
+		if (read_name(dir, name, sizeof(name)) ||
+		    strcmp(name, "ltc2990"))
+			continue;
+
+		a = opendir(dir);
+		if (!a)
+			continue;
+		(*nr_devices)++;
+		while ((ae = readdir(a)) && n < MAX_FILES) {
+			size_t len = strlen(ae->d_name);
+
+			if (len < 6 || strcmp(ae->d_name + len - 6, "_input"))
+				continue;
+			snprintf(path, sizeof(path), "%s/%s", dir, ae->d_name);
+			fds[n] = open(path, O_RDONLY);
+			if (fds[n] >= 0)
+				n++;
+		}
+		closedir(a);
+	}
+	closedir(d);
+
+	return n;
+}
+
+static int bench_attrs(const char *class, unsigned long long end,
+		       struct result *r, int *nr_devices)
+{
+	static int fds[MAX_FILES];
+	char val[32];
+	int n, i;
+
+	n = open_inputs(class, fds, nr_devices);
+	if (n <= 0)
+		return n ? n : -ENODEV;
+
+	while (clock_ns(CLOCK_MONOTONIC) < end) {
+		for (i = 0; i < n; i++) {
+			unsigned long long start = clock_ns(CLOCK_MONOTONIC);
+
+			r->syscalls++;
+			if (pread(fds[i], val, sizeof(val), 0) < 0) {
+				r->errors++;
+				continue;
+			}
+			add_latency(r, clock_ns(CLOCK_MONOTONIC) - start);
+			r->samples++;
+		}
+	}
+
+	for (i = 0; i < n; i++)
+		close(fds[i]);
+	return 0;
+}
+
+static void account(struct result *r, const struct ltc2990_snapshot *snaps,
+		    unsigned int count)
+{
+	unsigned long long now = clock_ns(CLOCK_MONOTONIC);
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		unsigned int k = __builtin_popcount(snaps[i].valid);
+
+		r->samples += k;
+		while (k--)
+			add_latency(r, now - snaps[i].timestamp);
+	}
+}
+
+static int bench_ioctl(unsigned long long end, struct result *r,
+		       int *nr_devices)
+{
+	struct ltc2990_snapshot_req req = { 0 };
+	struct ltc2990_snapshot *snaps;
+	int fd;
+
+	fd = open("/dev/ltc2990", O_RDONLY);
+	if (fd < 0 || ioctl(fd, LTC2990_IOC_SNAPSHOT, &req) < 0)
+		return -errno;
+	*nr_devices = req.total;
+
+	snaps = calloc(req.total ? req.total : 1, sizeof(*snaps));
+	if (!snaps)
+		return -ENOMEM;
+
+	while (clock_ns(CLOCK_MONOTONIC) < end) {
+		req.count = *nr_devices;
+		req.snapshots = (uintptr_t)snaps;
+		r->syscalls++;
+		if (ioctl(fd, LTC2990_IOC_SNAPSHOT, &req) < 0) {
+			r->errors++;
+			continue;
+		}
+		account(r, snaps, req.count);
+	}
+
+	free(snaps);
+	close(fd);
+	return 0;
+}
+
+static int bench_netlink(unsigned long long end, struct result *r,
+			 int *nr_devices)
+{
+	struct timeval tv = { .tv_sec = 1 };
+	struct nlmsghdr *n;
+	struct nlattr *a;
+	int fd, len, rem;
+
+	fd = ltc2990_genl_subscribe(buf, sizeof(buf));
+	if (fd < 0)
+		return fd;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	while (clock_ns(CLOCK_MONOTONIC) < end) {
+		r->syscalls++;
+		len = recv(fd, buf, sizeof(buf), 0);
+		if (len < 0) {
+			if (errno != EAGAIN)
+				r->errors++;
+			continue;
+		}
+		for (n = (struct nlmsghdr *)buf;
+		     NLMSG_OK(n, (unsigned int)len); n = NLMSG_NEXT(n, len)) {
+			rem = n->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+			for (a = GENL_ATTRS(n); NLA_OK(a, rem);
+			     a = NLA_NEXT(a, rem)) {
+				if (a->nla_type == LTC2990_ATTR_TOTAL)
+					*nr_devices = *(__u32 *)NLA_DATA(a);
+				if (a->nla_type == LTC2990_ATTR_SNAPSHOTS)
+					account(r, NLA_DATA(a),
+						(a->nla_len - NLA_HDRLEN) /
+						sizeof(struct ltc2990_snapshot));
+			}
+		}
+	}
+
+	close(fd);
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-t seconds] sysfs|iio|ioctl|netlink\n",
+		name);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long wall, cpu, end;
+	struct result r = { 0 };
+	const char *iface;
+	int secs = 5, nr_devices = 0;
+	int opt, ret;
+	double s;
+
+	while ((opt = getopt(argc, argv, "t:")) != -1) {
+		switch (opt) {
+		case 't':
+			secs = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || secs <= 0)
+		usage(argv[0]);
+	iface = argv[optind];
+
+	r.lat = malloc(MAX_LATENCIES * sizeof(*r.lat));
+	if (!r.lat)
+		return EXIT_FAILURE;
+
+	wall = clock_ns(CLOCK_MONOTONIC);
+	cpu = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+	end = wall + secs * 1000000000ULL;
+
+	if (!strcmp(iface, "sysfs"))
+		ret = bench_attrs("/sys/class/hwmon", end, &r, &nr_devices);
+	else if (!strcmp(iface, "iio"))
+		ret = bench_attrs("/sys/bus/iio/devices", end, &r, &nr_devices);
+	else if (!strcmp(iface, "ioctl"))
+		ret = bench_ioctl(end, &r, &nr_devices);
+	else if (!strcmp(iface, "netlink"))
+		ret = bench_netlink(end, &r, &nr_devices);
+	else
+		usage(argv[0]);
+
+	if (ret < 0) {
+		fprintf(stderr, "%s: %s\n", iface, strerror(-ret));
+		return EXIT_FAILURE;
+	}
+
+	wall = clock_ns(CLOCK_MONOTONIC) - wall;
+	cpu = clock_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+	s = r.samples ? (double)r.samples : 1;
+	qsort(r.lat, r.nr_lat, sizeof(*r.lat), cmp_ull);
+
+	printf("{\"interface\": \"%s\", \"devices\": %d, \"seconds\": %.3f, "
+	       "\"samples\": %llu, \"errors\": %llu, "
+	       "\"samples_per_s\": %.1f, \"cpu_ns_per_sample\": %.1f, "
+	       "\"syscalls_per_sample\": %.4f, "
+	       "\"latency_ns\": {\"p50\": %llu, \"p99\": %llu, \"max\": %llu}}\n",
+	       iface, nr_devices, wall / 1e9, r.samples, r.errors,
+	       r.samples * 1e9 / wall, cpu / s, r.syscalls / s,
+	       r.nr_lat ? r.lat[r.nr_lat / 2] : 0,
+	       r.nr_lat ? r.lat[r.nr_lat * 99 / 100] : 0,
+	       r.nr_lat ? r.lat[r.nr_lat - 1] : 0);
+
+	free(r.lat);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,39 @@
+#!/bin/sh
+#
+# ltc2990-ifbench.sh: acquisition interface benchmark over emulated devices
+#
+# Copyright (C) 2014 Topic Embedded Products
+#
+# License: GPLv2
+#
+# Usage: ltc2990-ifbench.sh [seconds] [results]
+#
+# Runs ltc2990-ifbench for every interface the loaded driver provides with
+# 1, 8 and 64 emulated chips and writes one JSON object per line to the
+# results file (default ltc2990-ifbench.json), for regression tracking.
+# The sampler runs every 10 ms so netlink has scans to deliver. Must be
+# run as root from the directory holding ltc2990-ifbench.
+
+set -e
+
+SECS=${1:-5}
+OUT=${2:-ltc2990-ifbench.json}
+
+modprobe ltc2990 sample_interval=10
+: > "$OUT"
+
+for n in 1 8 64; do
+	modprobe ltc2990-emu devices="$n"
+	sleep 1
+	for iface in sysfs iio ioctl netlink; do
+		if ./ltc2990-ifbench -t "$SECS" "$iface" > /tmp/ifbench.$$; then
+			sed "s/^{/{\"kernel\": \"$(uname -r)\", /" \
+				/tmp/ifbench.$$ | tee -a "$OUT"
+		else
+			echo "$iface: not available with $n devices" >&2
+		fi
+	done
+	rmmod ltc2990-emu
+done
+
+rm -f /tmp/ifbench.$$
@@ -0,0 +1,87 @@
+/*
+ * ltc2990-listen: print the LTC2990 sampler scans published over netlink
+ *
+ * Copyright (C) 2014 Topic Embedded Products
+ *
+ * License: GPLv2
+ *
+ * Resolves the "ltc2990" generic netlink family, joins its "samples"
+ * multicast group and prints one line per device and scan. Any number of
+ * listeners can run at the same time without adding bus traffic.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ltc2990-genl.h"
+
+static const char *const chan_names[LTC2990_CHAN_COUNT] = {
+	"temp1", "temp2", "temp3", "curr1", "curr2",
+	"in0", "in1", "in2", "in3", "in4",
+};
+
+static char buf[65536] __attribute__((aligned(8)));
+
+static void print_batch(struct nlmsghdr *n)
+{
+	const struct ltc2990_snapshot *snaps = NULL;
+	unsigned int scan = 0, count = 0, i, ch;
+	struct nlattr *a;
+	int rem;
+
+	rem = n->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+	for (a = GENL_ATTRS(n); NLA_OK(a, rem); a = NLA_NEXT(a, rem)) {
+		switch (a->nla_type) {
+		case LTC2990_ATTR_SCAN:
+			scan = *(__u32 *)NLA_DATA(a);
+			break;
+		case LTC2990_ATTR_SNAPSHOTS:
+			snaps = NLA_DATA(a);
+			count = (a->nla_len - NLA_HDRLEN) / sizeof(*snaps);
+			break;
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		const struct ltc2990_snapshot *s = &snaps[i];
+
+		printf("%u %u-%04x t=%llu", scan, s->adapter, s->addr,
+		       (unsigned long long)s->timestamp);
+		for (ch = 0; ch < LTC2990_CHAN_COUNT; ch++)
+			if (s->valid & (1u << ch))
+				printf(" %s=%d", chan_names[ch], s->value[ch]);
+		printf("\n");
+	}
+	fflush(stdout);
+}
+
+int main(void)
+{
+	struct nlmsghdr *n;
+	int fd, len;
+
+	fd = ltc2990_genl_subscribe(buf, sizeof(buf));
+	if (fd < 0) {
+		fprintf(stderr, "%s: %s\n", LTC2990_GENL_NAME, strerror(-fd));
+		return 1;
+	}
+
+	for (;;) {
+		len = recv(fd, buf, sizeof(buf), 0);
+		if (len < 0) {
+			if (errno == ENOBUFS) {
+				fprintf(stderr, "overrun, batches lost\n");
+				continue;
+			}
+			perror("recv");
+			return 1;
+		}
+		for (n = (struct nlmsghdr *)buf; NLMSG_OK(n, (unsigned int)len);
+		     n = NLMSG_NEXT(n, len))
+			if (((struct genlmsghdr *)NLMSG_DATA(n))->cmd ==
+			    LTC2990_CMD_SAMPLES)
+				print_batch(n);
+	}
+}
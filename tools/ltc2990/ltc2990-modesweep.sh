@@ -0,0 +1,41 @@
+#!/bin/sh
+#
+# ltc2990-modesweep.sh: switch an LTC2990 through all measurement modes
+#
+# Copyright (C) 2014 Topic Embedded Products
+#
+# License: GPLv2
+#
+# Usage: ltc2990-modesweep.sh <hwmon dir> [rounds]
+#
+# Writes each of the eight modes to the mode attribute in turn, lists the
+# inputs visible in that mode and the switch latency the driver measured.
+# The original mode is restored afterwards. Must be run as root with
+# debugfs mounted.
+
+set -e
+
+HWMON=${1:?usage: $0 <hwmon dir> [rounds]}
+ROUNDS=${2:-1}
+DEV=$(basename "$(readlink -f "$HWMON/device")")
+DBG=/sys/kernel/debug/ltc2990/$DEV/mode
+
+field() {
+	awk -v k="$1:" '$1 == k { print $2 }' "$DBG"
+}
+
+orig=$(cat "$HWMON/mode")
+trap 'echo "$orig" > "$HWMON/mode"' EXIT
+
+round=0
+while [ "$round" -lt "$ROUNDS" ]; do
+	for mode in 0 1 2 3 4 5 6 7; do
+		echo "$mode" > "$HWMON/mode"
+		inputs=$(cd "$HWMON" && ls *_input | tr '\n' ' ')
+		echo "mode $mode: $(field switch_ns) ns: $inputs"
+	done
+	round=$((round + 1))
+done
+
+echo "switches:      $(field switches)"
+echo "switch_max_ns: $(field switch_max_ns)"
@@ -0,0 +1,44 @@
+#!/bin/sh
+#
+# ltc2990-muxscan.sh: mux channel switches per sampler scan
+#
+# Copyright (C) 2014 Topic Embedded Products
+#
+# License: GPLv2
+#
+# Usage: ltc2990-muxscan.sh [devices] [per_bus] [seconds]
+#
+# Puts the emulated chips behind one emulated mux, probed round-robin
+# across the mux channels, and compares the channel selections the
+# emulated mux actually made per scan with the number the same scan would
+# need in probe order. Must be run as root with debugfs mounted.
+
+set -e
+
+N=${1:-64}
+PER_BUS=${2:-4}
+SECS=${3:-10}
+DBG=/sys/kernel/debug/ltc2990/sampler
+SWITCHES=/sys/module/ltc2990_emu/parameters/mux_switches
+
+field() {
+	awk -v k="$1:" '$1 == k { print $2 }' "$DBG"
+}
+
+modprobe ltc2990 sample_interval=100
+modprobe ltc2990-emu devices="$N" per_bus="$PER_BUS" mux=1 interleave=1
+trap 'rmmod ltc2990-emu' EXIT
+
+sleep 1
+scans=$(field scans)
+echo 0 > "$SWITCHES"
+sleep "$SECS"
+scans=$(($(field scans) - scans))
+switches=$(cat "$SWITCHES")
+
+echo "devices:                $N"
+echo "channels:               $(((N + PER_BUS - 1) / PER_BUS))"
+echo "scans:                  $scans"
+echo "measured_per_scan:      $((switches / (scans ? scans : 1)))"
+echo "expected_per_scan:      $(field mux_switches)"
+echo "probe_order_per_scan:   $(field mux_switches_probe)"
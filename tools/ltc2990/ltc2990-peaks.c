@@ -0,0 +1,98 @@
+/*
+ * ltc2990-peaks: print per-interval extremes of all LTC2990 channels
+ *
+ * Copyright (C) 2014 Topic Embedded Products
+ *
+ * License: GPLv2
+ *
+ * Reads /dev/ltc2990 every interval and prints, for every device and
+ * channel, the minimum, maximum, mean and number of valid samples since
+ * the previous read:
+ *
+ *   ltc2990-peaks [-i interval_ms] [-n reads]
+ *
+ * Every open handle of the control device has its own cursors, so any
+ * number of instances can run side by side, each seeing the peaks of its
+ * own intervals. Reading adds no bus traffic; the intervals cover the
+ * refreshes done by the sampler and by other readers.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <linux/ltc2990.h>
+
+#define MAX_DEVICES	1024
+
+static const char *const chan_names[LTC2990_CHAN_COUNT] = {
+	"temp1", "temp2", "temp3", "curr1", "curr2",
+	"in0", "in1", "in2", "in3", "in4",
+};
+
+static struct ltc2990_interval ivs[MAX_DEVICES];
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-i interval_ms] [-n reads]\n", name);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long interval = 1000, reads = 0, r;
+	unsigned int i, n, ch;
+	ssize_t len;
+	int fd, opt;
+
+	while ((opt = getopt(argc, argv, "i:n:")) != -1) {
+		switch (opt) {
+		case 'i':
+			interval = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			reads = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc || !interval)
+		usage(argv[0]);
+
+	fd = open("/dev/ltc2990", O_RDONLY);
+	if (fd < 0) {
+		perror("/dev/ltc2990");
+		return EXIT_FAILURE;
+	}
+
+	for (r = 0; !reads || r < reads; r++) {
+		usleep(interval * 1000);
+		len = read(fd, ivs, sizeof(ivs));
+		if (len < 0) {
+			perror("read");
+			return EXIT_FAILURE;
+		}
+
+		n = len / sizeof(*ivs);
+		for (i = 0; i < n; i++) {
+			const struct ltc2990_interval *iv = &ivs[i];
+
+			printf("%u-%04x refreshes=%u", iv->adapter, iv->addr,
+			       iv->refreshes);
+			for (ch = 0; ch < LTC2990_CHAN_COUNT; ch++)
+				if (iv->valid & (1u << ch))
+					printf(" %s=%d/%d/%d/%u", chan_names[ch],
+					       iv->min[ch], iv->max[ch],
+					       iv->mean[ch], iv->count[ch]);
+			printf("\n");
+		}
+		fflush(stdout);
+	}
+
+	close(fd);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,226 @@
+/*
+ * ltc2990-query: time range aggregates over an LTC2990 capture
+ *
+ * Copyright (C) 2014 Topic Embedded Products
+ *
+ * License: GPLv2
+ *
+ * Prints the number, minimum, maximum and mean of the valid samples of
+ * one channel within a time range of a capture written by ltc2990-capture:
+ *
+ *   ltc2990-query [-d adapter-addr] [-s from] [-e to] file channel
+ *
+ * from and to are seconds since the first sample of the capture, or with
+ * a leading @ seconds since the epoch, e.g. -s @$(date -d 10:02 +%s). The
+ * range includes both ends and defaults to the whole capture; -d limits
+ * the query to one device, e.g. -d 1-004c. Values are in the driver units
+ * of the channel.
+ *
+ * The capture is mapped, not read. Blocks outside the range are skipped on
+ * their header alone, blocks entirely inside it answer from their header
+ * summaries and only the blocks cut by a range end have their time and
+ * channel columns read.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ltc2990-capture.h"
+#include "ltc2990-conv.h"
+
+/* the capture columns follow the uapi order, which is the driver's */
+_Static_assert((int)LTC2990_NUM_CHANNELS == LTC2990_CHAN_COUNT &&
+	       (int)LTC2990_CURR1 == LTC2990_CHAN_CURR1 &&
+	       (int)LTC2990_IN4 == LTC2990_CHAN_IN4, "channel tables differ");
+
+static const char *const chan_names[LTC2990_CHAN_COUNT] = {
+	LTC2990_CHANNELS(LTC2990_CHAN_NAME)
+};
+
+struct agg {
+	unsigned long long count;
+	long long sum;
+	__s32 min, max;
+};
+
+static void agg_add(struct agg *a, __s32 v)
+{
+	if (!a->count || v < a->min)
+		a->min = v;
+	if (!a->count || v > a->max)
+		a->max = v;
+	a->sum += v;
+	a->count++;
+}
+
+/* Index of the first time at or after t */
+static unsigned int lower_bound(const __u64 *time, unsigned int n, __u64 t)
+{
+	unsigned int lo = 0, hi = n;
+
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+
+		if (time[mid] < t)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* Parse a range end into CLOCK_MONOTONIC ns */
+static __u64 parse_time(const char *arg, const struct ltc2990_cap_hdr *hdr,
+			__u64 start)
+{
+	double secs;
+
+	if (arg[0] == '@') {
+		secs = strtod(arg + 1, NULL);
+		return (__s64)(secs * 1e9) - hdr->realtime_offset;
+	}
+	secs = strtod(arg, NULL);
+	return start + (__s64)(secs * 1e9);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [-d adapter-addr] [-s from] [-e to] file channel\n",
+		name);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long skipped = 0, summarised = 0, scanned = 0;
+	const char *from = NULL, *to = NULL;
+	unsigned int adapter = 0, addr = 0;
+	const struct ltc2990_cap_hdr *hdr;
+	struct ltc2990_cap_block *b;
+	unsigned int ch, n, lo, hi, i;
+	__u64 nblocks, k, start = UINT64_MAX, t0, t1;
+	struct agg a = { 0 };
+	int opt, fd, dev = 0;
+	struct stat st;
+	char *map;
+
+	while ((opt = getopt(argc, argv, "d:s:e:")) != -1) {
+		switch (opt) {
+		case 'd':
+			if (sscanf(optarg, "%u-%x", &adapter, &addr) != 2)
+				usage(argv[0]);
+			dev = 1;
+			break;
+		case 's':
+			from = optarg;
+			break;
+		case 'e':
+			to = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 2)
+		usage(argv[0]);
+	for (ch = 0; ch < LTC2990_CHAN_COUNT; ch++)
+		if (!strcmp(argv[optind + 1], chan_names[ch]))
+			break;
+	if (ch == LTC2990_CHAN_COUNT)
+		usage(argv[0]);
+
+	fd = open(argv[optind], O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		perror(argv[optind]);
+		return EXIT_FAILURE;
+	}
+	if (st.st_size < LTC2990_CAP_ALIGN) {
+		fprintf(stderr, "%s: not a capture\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		return EXIT_FAILURE;
+	}
+	hdr = (const struct ltc2990_cap_hdr *)map;
+	if (hdr->magic != LTC2990_CAP_MAGIC ||
+	    hdr->version != LTC2990_CAP_VERSION ||
+	    hdr->block_size != ltc2990_cap_block_size(hdr->block_samples)) {
+		fprintf(stderr, "%s: not a capture\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+	n = hdr->block_samples;
+	/* a capture that is still being written may be ahead of nr_blocks */
+	nblocks = (st.st_size - LTC2990_CAP_ALIGN) / hdr->block_size;
+
+#define BLOCK(k) ((struct ltc2990_cap_block *)(map + LTC2990_CAP_ALIGN + \
+					       (k) * hdr->block_size))
+
+	for (k = 0; k < nblocks; k++) {
+		b = BLOCK(k);
+		if (b->magic == LTC2990_CAP_BLOCK_MAGIC && b->count &&
+		    b->t_first < start)
+			start = b->t_first;
+	}
+	t0 = from ? parse_time(from, hdr, start) : 0;
+	t1 = to ? parse_time(to, hdr, start) : UINT64_MAX;
+
+	for (k = 0; k < nblocks; k++) {
+		b = BLOCK(k);
+		if (b->magic != LTC2990_CAP_BLOCK_MAGIC || !b->count ||
+		    b->count > n)
+			continue;
+		if ((dev && (b->adapter != adapter || b->addr != addr)) ||
+		    !(b->valid & (1u << ch)) ||
+		    b->t_last < t0 || b->t_first > t1) {
+			skipped++;
+			continue;
+		}
+
+		if (b->t_first >= t0 && b->t_last <= t1) {
+			if (b->nvalid[ch]) {
+				struct agg s = {
+					b->nvalid[ch], b->sum[ch],
+					b->min[ch], b->max[ch],
+				};
+
+				if (!a.count || s.min < a.min)
+					a.min = s.min;
+				if (!a.count || s.max > a.max)
+					a.max = s.max;
+				a.sum += s.sum;
+				a.count += s.count;
+			}
+			summarised++;
+			continue;
+		}
+
+		lo = lower_bound(ltc2990_cap_time(b), b->count, t0);
+		hi = t1 == UINT64_MAX ? b->count :
+		     lower_bound(ltc2990_cap_time(b), b->count, t1 + 1);
+		for (i = lo; i < hi; i++)
+			if (ltc2990_cap_valid(b, n)[i] & (1u << ch))
+				agg_add(&a, ltc2990_cap_column(b, n, ch)[i]);
+		scanned++;
+	}
+
+	printf("%s:\tcount %llu", chan_names[ch], a.count);
+	if (a.count)
+		printf("\tmin %d\tmax %d\tmean %.3f", a.min, a.max,
+		       (double)a.sum / a.count);
+	printf("\nblocks:\t%lu summarised\t%lu scanned\t%lu skipped\n",
+	       summarised, scanned, skipped);
+
+	munmap(map, st.st_size);
+	close(fd);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,96 @@
+/*
+ * ltc2990-readbench: time repeated reads of an LTC2990 hwmon attribute
+ *
+ * Copyright (C) 2014 Topic Embedded Products
+ *
+ * License: GPLv2
+ *
+ * Reads the given sysfs attribute the requested number of times through a
+ * single open file descriptor and reports the per-read cost. Failed reads
+ * are counted and included in the latency figures. Run it with
+ * /sys/kernel/debug/ltc2990/instrumentation set to N and then Y to compare
+ * the hot path with and without instrumentation:
+ *
+ *   ltc2990-readbench -n 100000 /sys/class/hwmon/hwmon0/curr1_input
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-n count] <attribute>\n", name);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long *samples, start, total = 0;
+	unsigned long count = 10000, errors = 0, i;
+	char buf[32];
+	int fd, opt;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind >= argc || !count)
+		usage(argv[0]);
+
+	samples = calloc(count, sizeof(*samples));
+	if (!samples)
+		return EXIT_FAILURE;
+
+	fd = open(argv[optind], O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < count; i++) {
+		start = now_ns();
+		if (pread(fd, buf, sizeof(buf), 0) < 0)
+			errors++;
+		samples[i] = now_ns() - start;
+		total += samples[i];
+	}
+	close(fd);
+
+	qsort(samples, count, sizeof(*samples), cmp_ull);
+	printf("reads:\t%lu\n", count);
+	printf("errors:\t%lu\n", errors);
+	printf("mean:\t%llu ns\n", total / count);
+	printf("p50:\t%llu ns\n", samples[count / 2]);
+	printf("p99:\t%llu ns\n", samples[count * 99 / 100]);
+	printf("p999:\t%llu ns\n", samples[count * 999 / 1000]);
+	printf("max:\t%llu ns\n", samples[count - 1]);
+
+	free(samples);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,39 @@
+#!/bin/sh
+#
+# ltc2990-record.sh: capture raw LTC2990 register reads for later replay
+#
+# Copyright (C) 2014 Topic Embedded Products
+#
+# License: GPLv2
+#
+# Usage: ltc2990-record.sh <seconds> <capture> [interval ms]
+#
+# Enables the ltc2990:ltc2990_raw trace event, which fires on every cache
+# refresh with the raw TINT, V1-V4 and VCC registers, and saves the events
+# of the given number of seconds. The sampler refreshes every device at the
+# given interval (default 10 ms) while recording. Convert the capture with
+# ltc2990-trace2replay and load it with ltc2990-emu replay=<file>. Must be
+# run as root with tracefs available.
+
+set -e
+
+SECS=${1:?usage: $0 <seconds> <capture> [interval ms]}
+OUT=${2:?usage: $0 <seconds> <capture> [interval ms]}
+INTERVAL=${3:-10}
+
+T=/sys/kernel/debug/tracing
+[ -d /sys/kernel/tracing/events ] && T=/sys/kernel/tracing
+
+rmmod ltc2990 2>/dev/null || true
+modprobe ltc2990 sample_interval="$INTERVAL"
+
+echo mono > "$T/trace_clock"
+echo > "$T/trace"
+echo 1 > "$T/events/ltc2990/ltc2990_raw/enable"
+trap 'echo 0 > "$T/events/ltc2990/ltc2990_raw/enable"' EXIT
+
+sleep "$SECS"
+echo 0 > "$T/events/ltc2990/ltc2990_raw/enable"
+cat "$T/trace" > "$OUT"
+
+echo "$(grep -c ltc2990_raw "$OUT") events in $OUT"
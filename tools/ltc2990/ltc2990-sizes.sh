@@ -0,0 +1,45 @@
+#!/bin/sh
+#
+# ltc2990-sizes.sh: report the LTC2990 driver size for each feature tier
+#
+# Copyright (C) 2014 Topic Embedded Products
+#
+# License: GPLv2
+#
+# Usage: ltc2990-sizes.sh <kernel tree> [make arguments]
+#
+# The kernel tree must contain this driver and a configured .config with
+# SENSORS_LTC2990 enabled. The .config is restored afterwards.
+
+set -e
+
+KDIR=${1:?usage: $0 <kernel tree> [make arguments]}
+shift
+
+OPTS="CACHE SAMPLER HISTORY IIO"
+
+cd "$KDIR"
+cp .config .config.ltc2990-sizes
+trap 'mv .config.ltc2990-sizes .config' EXIT
+
+build() {
+	for opt in $OPTS; do
+		scripts/config --disable SENSORS_LTC2990_$opt
+	done
+	for opt in "$@"; do
+		scripts/config --enable SENSORS_LTC2990_$opt
+	done
+	make $MAKEARGS olddefconfig >/dev/null
+	make $MAKEARGS drivers/hwmon/ltc2990.o >/dev/null
+	printf '%-28s ' "${*:-minimal}"
+	size drivers/hwmon/ltc2990.o | awk 'NR == 2 { print $1, $2, $3, $4 }'
+}
+
+MAKEARGS="$*"
+printf '%-28s text data bss dec\n' configuration
+build
+build CACHE
+build CACHE SAMPLER
+build CACHE HISTORY
+build CACHE SAMPLER HISTORY
+build CACHE SAMPLER HISTORY IIO
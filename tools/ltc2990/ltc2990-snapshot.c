@@ -0,0 +1,70 @@
+/*
+ * ltc2990-snapshot: print the latest measurements of all LTC2990 devices
+ *
+ * Copyright (C) 2014 Topic Embedded Products
+ *
+ * License: GPLv2
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <linux/ltc2990.h>
+
+static const char *const chan_names[LTC2990_CHAN_COUNT] = {
+	"temp1", "temp2", "temp3", "curr1", "curr2",
+	"in0", "in1", "in2", "in3", "in4",
+};
+
+int main(int argc, char **argv)
+{
+	const char *dev = argc > 1 ? argv[1] : "/dev/ltc2990";
+	struct ltc2990_snapshot_req req;
+	struct ltc2990_snapshot *snaps = NULL;
+	unsigned int i, ch;
+	int fd;
+
+	fd = open(dev, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "%s: %s\n", dev, strerror(errno));
+		return 1;
+	}
+
+	/* the device count can change between the calls, so retry */
+	memset(&req, 0, sizeof(req));
+	for (;;) {
+		if (ioctl(fd, LTC2990_IOC_SNAPSHOT, &req) < 0) {
+			fprintf(stderr, "snapshot: %s\n", strerror(errno));
+			return 1;
+		}
+		if (req.count == req.total)
+			break;
+		free(snaps);
+		snaps = calloc(req.total, sizeof(*snaps));
+		if (!snaps && req.total)
+			return 1;
+		req.count = req.total;
+		req.snapshots = (uintptr_t)snaps;
+	}
+
+	for (i = 0; i < req.count; i++) {
+		const struct ltc2990_snapshot *s = &snaps[i];
+
+		printf("%u-%04x mode=%u t=%llu", s->adapter, s->addr, s->mode,
+		       (unsigned long long)s->timestamp);
+		for (ch = 0; ch < LTC2990_CHAN_COUNT; ch++)
+			if (s->valid & (1u << ch))
+				printf(" %s=%d", chan_names[ch], s->value[ch]);
+		printf("\n");
+	}
+
+	free(snaps);
+	close(fd);
+	return 0;
+}
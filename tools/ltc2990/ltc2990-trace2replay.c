@@ -0,0 +1,139 @@
+/*
+ * ltc2990-trace2replay: convert recorded ltc2990_raw events to a replay trace
+ *
+ * Copyright (C) 2014 Topic Embedded Products
+ *
+ * License: GPLv2
+ *
+ * Reads the text output of the ltc2990:ltc2990_raw trace event, as saved
+ * by ltc2990-record.sh, and writes the register trace of one device in the
+ * format the ltc2990-emu replay parameter loads from the firmware path:
+ *
+ *   ltc2990-trace2replay [-d 1-004c] capture.txt /lib/firmware/rack.ltct
+ *
+ * Without -d the first device found in the capture is used. Registers a
+ * record did not read keep the value of the previous record.
+ */
+
+#include <endian.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <linux/ltc2990.h>
+
+#define NUM_REGS	6
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-d adapter-addr] <capture> <trace>\n",
+		name);
+	exit(EXIT_FAILURE);
+}
+
+/* Parse one event line, returns 0 if it is an ltc2990_raw event */
+static int parse_line(const char *line, double *ts, char *dev, size_t devlen,
+		      unsigned int *mode, unsigned int *mask,
+		      unsigned int raw[NUM_REGS])
+{
+	const char *ev = strstr(line, ": ltc2990_raw: ");
+	const char *p;
+	char name[32];
+
+	if (!ev)
+		return -1;
+
+	/* the timestamp is the word before the event name */
+	for (p = ev; p > line && p[-1] != ' '; p--)
+		;
+	*ts = strtod(p, NULL);
+
+	if (sscanf(ev + strlen(": ltc2990_raw: "),
+		   "%31s mode=%u mask=%x raw=%x,%x,%x,%x,%x,%x", name, mode,
+		   mask, &raw[0], &raw[1], &raw[2], &raw[3], &raw[4],
+		   &raw[5]) != 9)
+		return -1;
+
+	snprintf(dev, devlen, "%s", name);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct ltc2990_trace_hdr hdr;
+	struct ltc2990_trace_rec rec;
+	unsigned int raw[NUM_REGS], mode, mask, count = 0;
+	unsigned int last[NUM_REGS] = { 0 };
+	char want[32] = "", dev[32], line[512];
+	double ts, first = 0;
+	FILE *in, *out;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "d:")) != -1) {
+		switch (opt) {
+		case 'd':
+			snprintf(want, sizeof(want), "%s", optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 2)
+		usage(argv[0]);
+
+	in = fopen(argv[optind], "r");
+	out = fopen(argv[optind + 1], "wb");
+	if (!in || !out) {
+		fprintf(stderr, "%s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	/* the header is rewritten with the final count at the end */
+	memset(&hdr, 0, sizeof(hdr));
+	memset(&rec, 0, sizeof(rec));
+	fwrite(&hdr, sizeof(hdr), 1, out);
+
+	while (fgets(line, sizeof(line), in)) {
+		if (parse_line(line, &ts, dev, sizeof(dev), &mode, &mask, raw))
+			continue;
+		if (!want[0])
+			snprintf(want, sizeof(want), "%s", dev);
+		if (strcmp(dev, want))
+			continue;
+
+		if (!count) {
+			first = ts;
+			hdr.mode = mode;
+		}
+
+		rec.t_us = htole64((__u64)((ts - first) * 1e6 + 0.5));
+		for (i = 0; i < NUM_REGS; i++) {
+			if (mask & (1u << i))
+				last[i] = raw[i];
+			rec.raw[i] = htole16(last[i]);
+		}
+		fwrite(&rec, sizeof(rec), 1, out);
+		count++;
+	}
+
+	if (!count) {
+		fprintf(stderr, "no ltc2990_raw events%s%s\n",
+			want[0] ? " for " : "", want);
+		return EXIT_FAILURE;
+	}
+
+	hdr.magic = htole32(LTC2990_TRACE_MAGIC);
+	hdr.version = htole16(LTC2990_TRACE_VERSION);
+	hdr.count = htole32(count);
+	rewind(out);
+	fwrite(&hdr, sizeof(hdr), 1, out);
+	if (fclose(out)) {
+		fprintf(stderr, "%s: %s\n", argv[optind + 1], strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	printf("%s: %u records, %.3f s\n", want, count, ts - first);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,358 @@
+/*
+ * ltc2990-uring: scrape all LTC2990 hwmon attributes with io_uring
+ *
+ * Copyright (C) 2014 Topic Embedded Products
+ *
+ * License: GPLv2
+ *
+ * Opens every *_input attribute of every hwmon device named ltc2990 once,
+ * then scrapes them all repeatedly, alternating between one io_uring
+ * submission per scrape and a sequential pread loop, and reports the wall
+ * time per scrape of both:
+ *
+ *   ltc2990-uring [-n scrapes] [-q depth]
+ *
+ * The files are registered with the ring, so a scrape is one io_uring_enter
+ * that submits every read and waits for all of them. Scrapes with more
+ * attributes than the queue depth take one io_uring_enter per depth reads.
+ * Attributes of channels that are inactive in the current mode fail with
+ * ENODATA and are counted separately from real errors. liburing is not
+ * needed; the ring is set up with the raw system calls.
+ *
+ * IORING_OP_READ needs Linux 5.6 or later, while the driver builds on 4.10
+ * to 4.14 only, so this cannot be run against the driver in this tree; it
+ * is for a port of the driver to a current kernel. On older kernels the
+ * ring cannot be set up, or every read completes with EINVAL.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/io_uring.h>
+
+#define MAX_FILES	4096
+#define VAL_SIZE	32
+
+struct ring {
+	int fd;
+	unsigned int entries;
+	unsigned int *sq_tail, *sq_mask, *sq_array;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+};
+
+struct result {
+	unsigned long long *ns;
+	unsigned long values;
+	unsigned long inactive;
+	unsigned long errors;
+	long long checksum;
+};
+
+static int fds[MAX_FILES];
+static char vals[MAX_FILES][VAL_SIZE];
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int read_name(const char *dir, char *name, size_t len)
+{
+	char path[1024];
+	FILE *f;
+	int ret;
+
+	snprintf(path, sizeof(path), "%s/name", dir);
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	ret = fgets(name, len, f) ? 0 : -1;
+	fclose(f);
+	name[strcspn(name, "\n")] = 0;
+	return ret;
+}
+
+/* Open every *_input attribute of all hwmon devices named ltc2990 */
+static int open_inputs(int *nr_devices)
+{
+	const char *class = "/sys/class/hwmon";
+	struct dirent *de, *ae;
+	char dir[512], path[1024], name[32];
+	DIR *d, *a;
+	int n = 0;
+
+	*nr_devices = 0;
+	d = opendir(class);
+	if (!d)
+		return -errno;
+
+	while ((de = readdir(d))) {
+		if (de->d_name[0] == '.')
+			continue;
+		snprintf(dir, sizeof(dir), "%s/%s", class, de->d_name);
+		if (read_name(dir, name, sizeof(name)) ||
+		    strcmp(name, "ltc2990"))
+			continue;
+
+		a = opendir(dir);
+		if (!a)
+			continue;
+		(*nr_devices)++;
+		while ((ae = readdir(a)) && n < MAX_FILES) {
+			size_t len = strlen(ae->d_name);
+
+			if (len < 6 || strcmp(ae->d_name + len - 6, "_input"))
+				continue;
+			snprintf(path, sizeof(path), "%s/%s", dir, ae->d_name);
+			fds[n] = open(path, O_RDONLY);
+			if (fds[n] >= 0)
+				n++;
+		}
+		closedir(a);
+	}
+	closedir(d);
+
+	return n;
+}
+
+static int ring_setup(struct ring *r, unsigned int entries)
+{
+	struct io_uring_params p;
+	size_t sq_size, cq_size;
+	void *sq, *cq;
+
+	memset(&p, 0, sizeof(p));
+	r->fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (r->fd < 0)
+		return -errno;
+	r->entries = p.sq_entries;
+
+	sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		sq_size = cq_size = sq_size > cq_size ? sq_size : cq_size;
+
+	sq = mmap(NULL, sq_size, PROT_READ | PROT_WRITE,
+		  MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (sq == MAP_FAILED)
+		return -errno;
+	cq = sq;
+	if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+		cq = mmap(NULL, cq_size, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+		if (cq == MAP_FAILED)
+			return -errno;
+	}
+	r->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+		       PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		       r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED)
+		return -errno;
+
+	r->sq_tail = (unsigned int *)((char *)sq + p.sq_off.tail);
+	r->sq_mask = (unsigned int *)((char *)sq + p.sq_off.ring_mask);
+	r->sq_array = (unsigned int *)((char *)sq + p.sq_off.array);
+	r->cq_head = (unsigned int *)((char *)cq + p.cq_off.head);
+	r->cq_tail = (unsigned int *)((char *)cq + p.cq_off.tail);
+	r->cq_mask = (unsigned int *)((char *)cq + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *)((char *)cq + p.cq_off.cqes);
+
+	return 0;
+}
+
+static void account(struct result *res, int i, int ret)
+{
+	if (ret == -ENODATA) {
+		res->inactive++;
+	} else if (ret < 0) {
+		res->errors++;
+	} else {
+		vals[i][ret < VAL_SIZE ? ret : VAL_SIZE - 1] = '\0';
+		res->checksum += strtol(vals[i], NULL, 10);
+		res->values++;
+	}
+}
+
+/* Read files first to first + n - 1 with one io_uring_enter */
+static int uring_batch(struct ring *r, int first, unsigned int n,
+		       struct result *res)
+{
+	unsigned int tail = *r->sq_tail, head, i;
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	int ret;
+
+	for (i = 0; i < n; i++) {
+		unsigned int idx = (tail + i) & *r->sq_mask;
+
+		sqe = &r->sqes[idx];
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = IORING_OP_READ;
+		sqe->flags = IOSQE_FIXED_FILE;
+		sqe->fd = first + i;
+		sqe->addr = (unsigned long)vals[first + i];
+		sqe->len = VAL_SIZE - 1;
+		sqe->off = 0;
+		sqe->user_data = first + i;
+		r->sq_array[idx] = idx;
+	}
+	__atomic_store_n(r->sq_tail, tail + n, __ATOMIC_RELEASE);
+
+	ret = syscall(__NR_io_uring_enter, r->fd, n, n,
+		      IORING_ENTER_GETEVENTS, NULL, 0);
+	if (ret < 0)
+		return -errno;
+
+	head = *r->cq_head;
+	while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+		cqe = &r->cqes[head & *r->cq_mask];
+		account(res, cqe->user_data, cqe->res);
+		head++;
+	}
+	__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+static int scrape_uring(struct ring *r, int n, struct result *res)
+{
+	unsigned int batch, left;
+	int first, ret;
+
+	for (first = 0; first < n; first += batch) {
+		left = n - first;
+		batch = left < r->entries ? left : r->entries;
+		ret = uring_batch(r, first, batch, res);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static void scrape_seq(int n, struct result *res)
+{
+	ssize_t len;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		len = pread(fds[i], vals[i], VAL_SIZE - 1, 0);
+		account(res, i, len < 0 ? -errno : len);
+	}
+}
+
+static void print(const char *name, struct result *res, unsigned long count)
+{
+	unsigned long long total = 0;
+	unsigned long i;
+
+	for (i = 0; i < count; i++)
+		total += res->ns[i];
+	qsort(res->ns, count, sizeof(*res->ns), cmp_ull);
+
+	printf("%s:\tvalues %lu\tinactive %lu\terrors %lu\tchecksum %lld\n",
+	       name, res->values, res->inactive, res->errors, res->checksum);
+	printf("\tmean %llu ns\tp50 %llu ns\tp99 %llu ns\tmax %llu ns\n",
+	       total / count, res->ns[count / 2], res->ns[count * 99 / 100],
+	       res->ns[count - 1]);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-n scrapes] [-q depth]\n", name);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	struct result uring = { 0 }, seq = { 0 };
+	unsigned long count = 1000, depth = 256, i;
+	unsigned long long start;
+	int n, nr_devices, opt, ret;
+	struct ring r = { .fd = -1 };
+
+	while ((opt = getopt(argc, argv, "n:q:")) != -1) {
+		switch (opt) {
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		case 'q':
+			depth = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc || !count || !depth)
+		usage(argv[0]);
+
+	n = open_inputs(&nr_devices);
+	if (n <= 0) {
+		fprintf(stderr, "hwmon: %s\n", strerror(n ? -n : ENODEV));
+		return EXIT_FAILURE;
+	}
+
+	ret = ring_setup(&r, depth);
+	if (!ret && syscall(__NR_io_uring_register, r.fd,
+			    IORING_REGISTER_FILES, fds, n) < 0)
+		ret = -errno;
+	if (ret) {
+		fprintf(stderr, "io_uring: %s%s\n", strerror(-ret),
+			ret == -ENOSYS ? ", needs Linux 5.6 or later" : "");
+		return EXIT_FAILURE;
+	}
+
+	uring.ns = calloc(count, sizeof(*uring.ns));
+	seq.ns = calloc(count, sizeof(*seq.ns));
+	if (!uring.ns || !seq.ns)
+		return EXIT_FAILURE;
+
+	printf("devices:\t%d\nattributes:\t%d\nqueue depth:\t%u\n",
+	       nr_devices, n, r.entries);
+
+	/* interleave so drift in the cache state hits both alike */
+	for (i = 0; i < count; i++) {
+		start = now_ns();
+		ret = scrape_uring(&r, n, &uring);
+		uring.ns[i] = now_ns() - start;
+		if (ret) {
+			fprintf(stderr, "io_uring_enter: %s\n", strerror(-ret));
+			return EXIT_FAILURE;
+		}
+
+		start = now_ns();
+		scrape_seq(n, &seq);
+		seq.ns[i] = now_ns() - start;
+	}
+
+	print("io_uring", &uring, count);
+	print("pread", &seq, count);
+
+	free(uring.ns);
+	free(seq.ns);
+	close(r.fd);
+	for (i = 0; i < (unsigned long)n; i++)
+		close(fds[i]);
+	return EXIT_SUCCESS;
+}